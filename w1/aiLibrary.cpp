@@ -1,11 +1,7 @@
 #include "aiLibrary.h"
 #include <flecs.h>
 #include "ecsTypes.h"
-#include <bx/rng.h>
-#include <cfloat>
-#include <cmath>
-
-static bx::RngShr3 rng;
+#include "aiUtils.h"
 
 class AttackEnemyState : public State
 {
@@ -15,60 +11,6 @@ public:
   void act(float/* dt*/, flecs::world &/*ecs*/, flecs::entity /*entity*/) const override {}
 };
 
-template<typename T>
-T sqr(T a){ return a*a; }
-
-template<typename T, typename U>
-static float dist_sq(const T &lhs, const U &rhs) { return float(sqr(lhs.x - rhs.x) + sqr(lhs.y - rhs.y)); }
-
-template<typename T, typename U>
-static float dist(const T &lhs, const U &rhs) { return sqrtf(dist_sq(lhs, rhs)); }
-
-template<typename T, typename U>
-static int move_towards(const T &from, const U &to)
-{
-  int deltaX = to.x - from.x;
-  int deltaY = to.y - from.y;
-  if (abs(deltaX) > abs(deltaY))
-    return deltaX > 0 ? EA_MOVE_RIGHT : EA_MOVE_LEFT;
-  return deltaY > 0 ? EA_MOVE_UP : EA_MOVE_DOWN;
-}
-
-static int inverse_move(int move)
-{
-  return move == EA_MOVE_LEFT ? EA_MOVE_RIGHT :
-         move == EA_MOVE_RIGHT ? EA_MOVE_LEFT :
-         move == EA_MOVE_UP ? EA_MOVE_DOWN :
-         move == EA_MOVE_DOWN ? EA_MOVE_UP : move;
-}
-
-
-template<typename Callable>
-static void on_closest_enemy_pos(flecs::world &ecs, flecs::entity entity, Callable c)
-{
-  static auto enemiesQuery = ecs.query<const Position, const Team>();
-  entity.set([&](const Position &pos, const Team &t, Action &a)
-  {
-    flecs::entity closestEnemy;
-    float closestDist = FLT_MAX;
-    Position closestPos;
-    enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
-    {
-      if (t.team == et.team)
-        return;
-      float curDist = dist(epos, pos);
-      if (curDist < closestDist)
-      {
-        closestDist = curDist;
-        closestPos = epos;
-        closestEnemy = enemy;
-      }
-    });
-    if (ecs.is_valid(closestEnemy))
-      c(a, pos, closestPos);
-  });
-}
-
 class MoveToEnemyState : public State
 {
 public:
@@ -76,10 +18,7 @@ public:
   void exit() const override {}
   void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
-    on_closest_enemy_pos(ecs, entity, [&](Action &a, const Position &pos, const Position &enemy_pos)
-    {
-      a.action = move_towards(pos, enemy_pos);
-    });
+    move_to_enemy(ecs, entity);
   }
 };
 
@@ -91,10 +30,7 @@ public:
   void exit() const override {}
   void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
-    on_closest_enemy_pos(ecs, entity, [&](Action &a, const Position &pos, const Position &enemy_pos)
-    {
-      a.action = inverse_move(move_towards(pos, enemy_pos));
-    });
+    flee_from_enemy(ecs, entity);
   }
 };
 
@@ -107,16 +43,7 @@ public:
   void exit() const override {}
   void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
-    entity.set([&](const Position &pos, const PatrolPos &ppos, Action &a)
-    {
-      if (dist(pos, ppos) > patrolDist)
-        a.action = move_towards(pos, ppos); // do a recovery walk
-      else
-      {
-        // do a random walk
-        a.action = EA_MOVE_START + (rng.gen() % (EA_MOVE_END - EA_MOVE_START));
-      }
-    });
+    patrol(ecs, entity, patrolDist);
   }
 };
 
@@ -135,19 +62,7 @@ public:
   EnemyAvailableTransition(float in_dist) : triggerDist(in_dist) {}
   bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
   {
-    static auto enemiesQuery = ecs.query<const Position, const Team>();
-    bool enemiesFound = false;
-    entity.get([&](const Position &pos, const Team &t)
-    {
-      enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
-      {
-        if (t.team == et.team)
-          return;
-        float curDist = dist(epos, pos);
-        enemiesFound |= curDist <= triggerDist;
-      });
-    });
-    return enemiesFound;
+    return is_enemy_available(ecs, entity, triggerDist);
   }
 };
 
@@ -156,14 +71,9 @@ class HitpointsLessThanTransition : public StateTransition
   float threshold;
 public:
   HitpointsLessThanTransition(float in_thres) : threshold(in_thres) {}
-  bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
+  bool isAvailable(flecs::world &/*ecs*/, flecs::entity entity) const override
   {
-    bool hitpointsThresholdReached = false;
-    entity.get([&](const Hitpoints &hp)
-    {
-      hitpointsThresholdReached |= hp.hitpoints < threshold;
-    });
-    return hitpointsThresholdReached;
+    return is_hitpoints_less_than(entity, threshold);
   }
 };
 
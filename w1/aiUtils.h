@@ -0,0 +1,119 @@
+#pragma once
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <flecs.h>
+#include "ecsTypes.h"
+#include "rng.h"
+
+// Behaviour bodies shared by the runtime built (aiLibrary) and the static (staticAiLibrary) state machines
+
+template<typename T>
+T sqr(T a){ return a*a; }
+
+template<typename T, typename U>
+inline float dist_sq(const T &lhs, const U &rhs) { return float(sqr(lhs.x - rhs.x) + sqr(lhs.y - rhs.y)); }
+
+template<typename T, typename U>
+inline float dist(const T &lhs, const U &rhs) { return sqrtf(dist_sq(lhs, rhs)); }
+
+template<typename T, typename U>
+inline int move_towards(const T &from, const U &to)
+{
+  int deltaX = to.x - from.x;
+  int deltaY = to.y - from.y;
+  if (abs(deltaX) > abs(deltaY))
+    return deltaX > 0 ? EA_MOVE_RIGHT : EA_MOVE_LEFT;
+  return deltaY > 0 ? EA_MOVE_UP : EA_MOVE_DOWN;
+}
+
+inline int inverse_move(int move)
+{
+  return move == EA_MOVE_LEFT ? EA_MOVE_RIGHT :
+         move == EA_MOVE_RIGHT ? EA_MOVE_LEFT :
+         move == EA_MOVE_UP ? EA_MOVE_DOWN :
+         move == EA_MOVE_DOWN ? EA_MOVE_UP : move;
+}
+
+template<typename Callable>
+inline void on_closest_enemy_pos(flecs::world &ecs, flecs::entity entity, Callable c)
+{
+  static auto enemiesQuery = ecs.query<const Position, const Team>();
+  entity.set([&](const Position &pos, const Team &t, Action &a)
+  {
+    flecs::entity closestEnemy;
+    float closestDist = FLT_MAX;
+    Position closestPos;
+    enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
+    {
+      if (t.team == et.team)
+        return;
+      float curDist = dist(epos, pos);
+      if (curDist < closestDist)
+      {
+        closestDist = curDist;
+        closestPos = epos;
+        closestEnemy = enemy;
+      }
+    });
+    if (ecs.is_valid(closestEnemy))
+      c(a, pos, closestPos);
+  });
+}
+
+inline void move_to_enemy(flecs::world &ecs, flecs::entity entity)
+{
+  on_closest_enemy_pos(ecs, entity, [&](Action &a, const Position &pos, const Position &enemy_pos)
+  {
+    a.action = move_towards(pos, enemy_pos);
+  });
+}
+
+inline void flee_from_enemy(flecs::world &ecs, flecs::entity entity)
+{
+  on_closest_enemy_pos(ecs, entity, [&](Action &a, const Position &pos, const Position &enemy_pos)
+  {
+    a.action = inverse_move(move_towards(pos, enemy_pos));
+  });
+}
+
+inline void patrol(flecs::world &ecs, flecs::entity entity, float patrol_dist)
+{
+  entity.set([&](const Position &pos, const PatrolPos &ppos, Action &a)
+  {
+    if (dist(pos, ppos) > patrol_dist)
+      a.action = move_towards(pos, ppos); // do a recovery walk
+    else
+    {
+      // do a random walk
+      a.action = entity_rng(ecs, entity).range(EA_MOVE_START, EA_MOVE_END - 1);
+    }
+  });
+}
+
+inline bool is_enemy_available(flecs::world &ecs, flecs::entity entity, float trigger_dist)
+{
+  static auto enemiesQuery = ecs.query<const Position, const Team>();
+  bool enemiesFound = false;
+  entity.get([&](const Position &pos, const Team &t)
+  {
+    enemiesQuery.each([&](const Position &epos, const Team &et)
+    {
+      if (t.team == et.team)
+        return;
+      float curDist = dist(epos, pos);
+      enemiesFound |= curDist <= trigger_dist;
+    });
+  });
+  return enemiesFound;
+}
+
+inline bool is_hitpoints_less_than(flecs::entity entity, float threshold)
+{
+  bool hitpointsThresholdReached = false;
+  entity.get([&](const Hitpoints &hp)
+  {
+    hitpointsThresholdReached |= hp.hitpoints < threshold;
+  });
+  return hitpointsThresholdReached;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 
 struct Position;
 struct MovePos;
@@ -114,3 +115,13 @@ struct Team
   int team = 0;
 };
 
+// world singletons, random streams of agents are keyed by them
+struct WorldSeed
+{
+  uint64_t seed = 0;
+};
+
+struct TurnCounter
+{
+  uint64_t turn = 0;
+};
@@ -1,12 +1,12 @@
 #pragma once
 #include <cstdint>
 
-constexpr uint16_t invalid_entity = -1;
+constexpr uint32_t invalid_entity = ~0u;
+// entity record as sent to clients
 struct Entity
 {
   uint32_t color = 0xff00ffff;
-  float x = 0.f;
-  float y = 0.f;
-  uint16_t eid = invalid_entity;
+  int32_t x = 0;
+  int32_t y = 0;
+  uint32_t eid = invalid_entity;
 };
-
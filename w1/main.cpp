@@ -9,9 +9,36 @@
 #include <flecs.h>
 #include "ecsTypes.h"
 #include "roguelike.h"
+#include "server.h"
+#include "snapshotCodec.h"
+#include "protocol.h"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 
 int main(int argc, const char **argv)
 {
+  uint32_t turns = 0;
+  for (int i = 1; i < argc; ++i)
+    if (!strcmp(argv[i], "--turns") && i + 1 < argc)
+      turns = uint32_t(strtoul(argv[i + 1], nullptr, 10));
+  for (int i = 1; i + 1 < argc; ++i)
+  {
+    const uint16_t port = uint16_t(strtoul(argv[i + 1], nullptr, 10));
+    if (!strcmp(argv[i], "--bench-snapshot"))
+      return run_snapshot_benchmark(atoi(argv[i + 1]), turns ? int(turns) : 1000);
+    if (!strcmp(argv[i], "--fuzz-protocol"))
+      return run_protocol_fuzz(uint32_t(strtoul(argv[i + 1], nullptr, 10)));
+    if (!strcmp(argv[i], "--bench-protocol"))
+      return run_protocol_benchmark(uint32_t(strtoul(argv[i + 1], nullptr, 10)));
+    if (!strcmp(argv[i], "--server"))
+      return run_server(port, turns);
+    if (!strcmp(argv[i], "--client"))
+      return run_bot_client(port, turns ? turns : 100);
+    if (!strcmp(argv[i], "--loopback") && i + 2 < argc)
+      return run_loopback_session(port, atoi(argv[i + 2]), turns ? turns : 100);
+  }
+
   int width = 1920;
   int height = 1080;
   if (!app_init(width, height))
@@ -31,6 +58,7 @@ int main(int argc, const char **argv)
   flecs::world ecs;
 
   init_roguelike(ecs);
+  ecs.set(WorldSeed{uint64_t(time(nullptr))});
 
   DebugDrawEncoder dde;
   while (!app_should_close())
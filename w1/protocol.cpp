@@ -1,95 +1,238 @@
-/*#include "protocol.h"
-#include <cstring> // memcpy
+#include "protocol.h"
+#include <chrono>
+#include <cstdio>
+#include "rng.h"
 
-void send_join(ENetPeer *peer)
+template<typename T>
+static uint8_t *write(uint8_t *ptr, const T &val)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t), ENET_PACKET_FLAG_RELIABLE);
-  *packet->data = E_CLIENT_TO_SERVER_JOIN;
+  memcpy(ptr, &val, sizeof(T));
+  return ptr + sizeof(T);
+}
 
-  enet_peer_send(peer, 0, packet);
+uint8_t *PacketWriter::beginMessage(MessageType type, size_t payload_size)
+{
+  const size_t at = buf.size();
+  buf.resize(at + message_header_size + payload_size);
+  uint8_t *ptr = buf.data() + at;
+  ptr = write(ptr, uint8_t(type));
+  return write(ptr, uint16_t(payload_size));
 }
 
-void send_new_entity(ENetPeer *peer, const Entity &ent)
+PacketWriter &PacketWriter::join()
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(Entity),
-                                                   ENET_PACKET_FLAG_RELIABLE);
-  uint8_t *ptr = packet->data;
-  *ptr = E_SERVER_TO_CLIENT_NEW_ENTITY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &ent, sizeof(Entity)); ptr += sizeof(Entity);
+  write(beginMessage(E_CLIENT_TO_SERVER_JOIN, sizeof(uint16_t)), protocol_version);
+  return *this;
+}
 
-  enet_peer_send(peer, 0, packet);
+PacketWriter &PacketWriter::leave()
+{
+  beginMessage(E_CLIENT_TO_SERVER_LEAVE, 0);
+  return *this;
 }
 
-void send_set_controlled_entity(ENetPeer *peer, uint16_t eid)
+PacketWriter &PacketWriter::setControlledEntity(uint32_t eid)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t),
-                                                   ENET_PACKET_FLAG_RELIABLE);
-  uint8_t *ptr = packet->data;
-  *ptr = E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY; ptr += sizeof(uint8_t);
-  memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
+  write(beginMessage(E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY, sizeof(uint32_t)), eid);
+  return *this;
+}
 
-  enet_peer_send(peer, 0, packet);
+PacketWriter &PacketWriter::input(uint8_t action)
+{
+  write(beginMessage(E_CLIENT_TO_SERVER_INPUT, sizeof(uint8_t)), action);
+  return *this;
 }
 
-void send_entity_state(ENetPeer *peer, uint16_t eid, float x, float y)
+PacketWriter &PacketWriter::ack(uint32_t turn)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   2 * sizeof(float),
-                                                   ENET_PACKET_FLAG_UNSEQUENCED);
-  uint8_t *ptr = packet->data;
-  *ptr = E_CLIENT_TO_SERVER_STATE; ptr += sizeof(uint8_t);
-  memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &x, sizeof(float)); ptr += sizeof(float);
-  memcpy(ptr, &y, sizeof(float)); ptr += sizeof(float);
+  write(beginMessage(E_CLIENT_TO_SERVER_ACK, sizeof(uint32_t)), turn);
+  return *this;
+}
 
-  enet_peer_send(peer, 1, packet);
+PacketWriter &PacketWriter::snapshot(const SnapshotState &snapshot, const SnapshotState *baseline)
+{
+  const size_t at = buf.size();
+  beginMessage(E_SERVER_TO_CLIENT_SNAPSHOT, 0);
+  encode_snapshot(snapshot, baseline, buf);
+  // payload size is only known after encoding, an oversized snapshot is dropped rather than truncated
+  const size_t payloadSize = buf.size() - at - message_header_size;
+  if (payloadSize > UINT16_MAX)
+    buf.resize(at);
+  else
+    write(buf.data() + at + sizeof(uint8_t), uint16_t(payloadSize));
+  return *this;
 }
 
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y)
+size_t PacketWriter::send(UdpSocket &sock, const NetAddress &to)
 {
-  ENetPacket *packet = enet_packet_create(nullptr, sizeof(uint8_t) + sizeof(uint16_t) +
-                                                   2 * sizeof(float),
-                                                   ENET_PACKET_FLAG_UNSEQUENCED);
-  uint8_t *ptr = packet->data;
-  *ptr = E_SERVER_TO_CLIENT_SNAPSHOT; ptr += sizeof(uint8_t);
-  memcpy(ptr, &eid, sizeof(uint16_t)); ptr += sizeof(uint16_t);
-  memcpy(ptr, &x, sizeof(float)); ptr += sizeof(float);
-  memcpy(ptr, &y, sizeof(float)); ptr += sizeof(float);
+  const size_t size = buf.size();
+  const bool sent = size > 0 && size <= max_packet_size && sock.sendTo(to, buf.data(), size);
+  buf.clear();
+  return sent ? size : 0;
+}
 
-  enet_peer_send(peer, 1, packet);
+bool PacketReader::next(MessageView &msg)
+{
+  if (size - offset < message_header_size)
+    return false;
+  const uint8_t type = data[offset];
+  uint16_t payloadSize = 0;
+  memcpy(&payloadSize, data + offset + sizeof(uint8_t), sizeof(payloadSize));
+  if (size - offset - message_header_size < payloadSize)
+    return false;
+  msg = MessageView(type < E_NUM_MESSAGES ? MessageType(type) : E_NUM_MESSAGES,
+                    data + offset + message_header_size, payloadSize);
+  offset += message_header_size + payloadSize;
+  return true;
 }
 
-MessageType get_packet_type(ENetPacket *packet)
+bool deserialize_snapshot(const MessageView &msg, const SnapshotHistory &history, SnapshotState &snapshot)
 {
-  return (MessageType)*packet->data;
+  return msg.type() == E_SERVER_TO_CLIENT_SNAPSHOT && decode_snapshot(msg.data(), msg.size(), history, snapshot);
 }
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent)
+struct FuzzMessage
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  ent = *(Entity*)(ptr); ptr += sizeof(Entity);
+  MessageType type;
+  uint32_t value;
+};
+
+static void write_fuzz_message(PacketWriter &writer, const FuzzMessage &msg, const SnapshotState &snapshot)
+{
+  switch (msg.type)
+  {
+    case E_CLIENT_TO_SERVER_JOIN: writer.join(); break;
+    case E_CLIENT_TO_SERVER_LEAVE: writer.leave(); break;
+    case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY: writer.setControlledEntity(msg.value); break;
+    case E_CLIENT_TO_SERVER_INPUT: writer.input(uint8_t(msg.value)); break;
+    case E_SERVER_TO_CLIENT_SNAPSHOT: writer.snapshot(snapshot, nullptr); break;
+    case E_CLIENT_TO_SERVER_ACK: writer.ack(msg.value); break;
+    case E_NUM_MESSAGES: break;
+  }
 }
 
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid)
+static bool check_fuzz_message(const MessageView &view, const FuzzMessage &msg, const SnapshotState &snapshot)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
+  if (view.type() != msg.type)
+    return false;
+  static const SnapshotHistory emptyHistory;
+  SnapshotState decoded;
+  switch (msg.type)
+  {
+    case E_CLIENT_TO_SERVER_JOIN: return JoinView(view).valid() && JoinView(view).version() == protocol_version;
+    case E_CLIENT_TO_SERVER_LEAVE: return view.size() == 0;
+    case E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY:
+      return SetControlledEntityView(view).valid() && SetControlledEntityView(view).eid() == msg.value;
+    case E_CLIENT_TO_SERVER_INPUT: return InputView(view).valid() && InputView(view).action() == uint8_t(msg.value);
+    case E_SERVER_TO_CLIENT_SNAPSHOT:
+      return deserialize_snapshot(view, emptyHistory, decoded) && same_entities(decoded.ents, snapshot.ents);
+    case E_CLIENT_TO_SERVER_ACK: return AckView(view).valid() && AckView(view).turn() == msg.value;
+    case E_NUM_MESSAGES: break;
+  }
+  return false;
 }
 
-void deserialize_entity_state(ENetPacket *packet, uint16_t &eid, float &x, float &y)
+// reads everything the views allow, corrupted input must never read out of the buffer
+static size_t consume_datagram(const uint8_t *data, size_t size, const SnapshotHistory &history)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  x = *(float*)(ptr); ptr += sizeof(float);
-  y = *(float*)(ptr); ptr += sizeof(float);
+  PacketReader reader(data, size);
+  SnapshotState snapshot;
+  size_t checksum = 0;
+  for (MessageView msg; reader.next(msg);)
+  {
+    if (JoinView(msg).valid())
+      checksum += JoinView(msg).version();
+    else if (SetControlledEntityView(msg).valid())
+      checksum += SetControlledEntityView(msg).eid();
+    else if (InputView(msg).valid())
+      checksum += InputView(msg).action();
+    else if (AckView(msg).valid())
+      checksum += AckView(msg).turn();
+    else if (deserialize_snapshot(msg, history, snapshot))
+      checksum += snapshot.ents.size();
+  }
+  return checksum;
 }
 
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y)
+int run_protocol_fuzz(uint32_t iterations)
 {
-  uint8_t *ptr = packet->data; ptr += sizeof(uint8_t);
-  eid = *(uint16_t*)(ptr); ptr += sizeof(uint16_t);
-  x = *(float*)(ptr); ptr += sizeof(float);
-  y = *(float*)(ptr); ptr += sizeof(float);
+  SnapshotHistory history;
+  std::vector<FuzzMessage> messages;
+  std::vector<uint8_t> mutated;
+  SnapshotState snapshot;
+  PacketWriter writer;
+  int failures = 0;
+  size_t checksum = 0;
+  for (uint32_t iter = 0; iter < iterations; ++iter)
+  {
+    CounterRng rng(0, iter, 0);
+    snapshot.turn = iter;
+    snapshot.ents.resize(size_t(rng.range(0, 64)));
+    for (size_t i = 0; i < snapshot.ents.size(); ++i)
+      snapshot.ents[i] = Entity{uint32_t(rng.next()), rng.range(-100, 100), rng.range(-100, 100), uint32_t(i * 7 + 1)};
+
+    // a valid batch has to come out exactly as written
+    messages.resize(size_t(rng.range(1, 8)));
+    for (FuzzMessage &msg : messages)
+      msg = FuzzMessage{MessageType(rng.range(0, E_NUM_MESSAGES - 1)), uint32_t(rng.next())};
+    writer.clear();
+    for (const FuzzMessage &msg : messages)
+      write_fuzz_message(writer, msg, snapshot);
+    PacketReader reader(writer.data(), writer.size());
+    MessageView view;
+    bool ok = true;
+    for (const FuzzMessage &msg : messages)
+      ok = ok && reader.next(view) && check_fuzz_message(view, msg, snapshot);
+    if (!ok || reader.next(view) || !reader.finished())
+      failures++;
+    history.store(snapshot);
+
+    // then the same batch with flipped bits, truncated or as plain garbage
+    mutated.assign(writer.data(), writer.data() + writer.size());
+    switch (rng.range(0, 2))
+    {
+      case 0:
+        for (int flips = rng.range(1, 8); flips > 0 && !mutated.empty(); --flips)
+          mutated[size_t(rng.range(0, int(mutated.size()) - 1))] ^= uint8_t(1 << rng.range(0, 7));
+        break;
+      case 1: mutated.resize(size_t(rng.range(0, int(mutated.size())))); break;
+      default:
+        for (uint8_t &b : mutated)
+          b = uint8_t(rng.next());
+    }
+    // exact sized copy, so out of bounds reads show up under sanitizers
+    const std::vector<uint8_t> exact(mutated);
+    checksum += consume_datagram(exact.data(), exact.size(), history);
+  }
+  printf("protocol fuzz: %u iterations, %d failed round trips (checksum %zu)\n", iterations, failures, checksum);
+  return failures == 0 ? 0 : 1;
 }
 
-*/
\ No newline at end of file
+int run_protocol_benchmark(uint32_t num_messages)
+{
+  PacketWriter writer;
+  for (uint32_t i = 0; i < num_messages; ++i)
+    if (i % 2 == 0)
+      writer.ack(i);
+    else
+      writer.input(uint8_t(i));
+  // odd offset, every field is misaligned
+  std::vector<uint8_t> buf(writer.size() + 1);
+  memcpy(buf.data() + 1, writer.data(), writer.size());
+
+  const auto start = std::chrono::steady_clock::now();
+  PacketReader reader(buf.data() + 1, writer.size());
+  uint64_t sum = 0;
+  uint32_t count = 0;
+  for (MessageView msg; reader.next(msg); ++count)
+  {
+    if (AckView(msg).valid())
+      sum += AckView(msg).turn();
+    else if (InputView(msg).valid())
+      sum += InputView(msg).action();
+  }
+  const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("protocol: %u messages, %.2f bytes/message, %.1f M messages/s (checksum %llu)\n", count,
+         double(writer.size()) / double(num_messages), double(count) / time * 1e-6, static_cast<unsigned long long>(sum));
+  return count == num_messages ? 0 : 1;
+}
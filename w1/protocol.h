@@ -1,27 +1,138 @@
 #pragma once
-#include <enet/enet.h>
+#include <cstddef>
 #include <cstdint>
+#include <cstring> // memcpy
+#include <vector>
+#include "udpSocket.h"
 #include "entity.h"
+#include "snapshotCodec.h"
 
 enum MessageType : uint8_t
 {
   E_CLIENT_TO_SERVER_JOIN = 0,
-  E_SERVER_TO_CLIENT_NEW_ENTITY,
+  E_CLIENT_TO_SERVER_LEAVE,
   E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY,
-  E_CLIENT_TO_SERVER_STATE,
-  E_SERVER_TO_CLIENT_SNAPSHOT
+  E_CLIENT_TO_SERVER_INPUT,
+  E_SERVER_TO_CLIENT_SNAPSHOT,
+  E_CLIENT_TO_SERVER_ACK,
+  E_NUM_MESSAGES
 };
 
-void send_join(ENetPeer *peer);
-void send_new_entity(ENetPeer *peer, const Entity &ent);
-void send_set_controlled_entity(ENetPeer *peer, uint16_t eid);
-void send_entity_state(ENetPeer *peer, uint16_t eid, float x, float y);
-void send_snapshot(ENetPeer *peer, uint16_t eid, float x, float y);
+// Wire schema, host endian. Bumped on any layout change, the server ignores joins of other versions.
+//   datagram: one or more messages, each is u8 type, u16 payload size, payload
+//   join:                  u16 protocol version
+//   leave:                 empty
+//   set controlled entity: u32 eid
+//   input:                 u8 action
+//   ack:                   u32 turn
+//   snapshot:              see snapshotCodec.h
+constexpr uint16_t protocol_version = 3;
+constexpr size_t message_header_size = sizeof(uint8_t) + sizeof(uint16_t);
 
-MessageType get_packet_type(ENetPacket *packet);
+// Snapshots are a single datagram each, delta encoded against the last one the client acknowledged,
+// so only the first snapshot of a crowded area gets fragmented by IP.
+constexpr size_t max_packet_size = 65507;
 
-void deserialize_new_entity(ENetPacket *packet, Entity &ent);
-void deserialize_set_controlled_entity(ENetPacket *packet, uint16_t &eid);
-void deserialize_entity_state(ENetPacket *packet, uint16_t &eid, float &x, float &y);
-void deserialize_snapshot(ENetPacket *packet, uint16_t &eid, float &x, float &y);
+// Appends messages to a single datagram
+class PacketWriter
+{
+  std::vector<uint8_t> buf;
+
+  uint8_t *beginMessage(MessageType type, size_t payload_size);
+public:
+  PacketWriter &join();
+  PacketWriter &leave();
+  PacketWriter &setControlledEntity(uint32_t eid);
+  PacketWriter &input(uint8_t action);
+  PacketWriter &ack(uint32_t turn);
+  // baseline is nullptr for a full snapshot
+  PacketWriter &snapshot(const SnapshotState &snapshot, const SnapshotState *baseline);
+
+  const uint8_t *data() const { return buf.data(); }
+  size_t size() const { return buf.size(); }
+  void clear() { buf.clear(); }
+  // sends everything written so far and clears the writer, returns number of bytes sent
+  size_t send(UdpSocket &sock, const NetAddress &to);
+};
+
+// Read-only view of a message inside a receive buffer. Fields are memcpy'd out of the buffer on
+// access, so views are valid at any alignment and nothing gets copied up front.
+class MessageView
+{
+  const uint8_t *payload = nullptr;
+  size_t payloadSize = 0;
+  MessageType msgType = E_NUM_MESSAGES;
+public:
+  MessageView() = default;
+  MessageView(MessageType type, const uint8_t *data, size_t size) : payload(data), payloadSize(size), msgType(type) {}
+
+  MessageType type() const { return msgType; }
+  const uint8_t *data() const { return payload; }
+  size_t size() const { return payloadSize; }
+
+  template<typename T>
+  T get(size_t offset) const
+  {
+    T val;
+    memcpy(&val, payload + offset, sizeof(T));
+    return val;
+  }
+};
+
+// Views of the fixed size messages, fields may only be read if valid()
+template<MessageType Type, size_t Size>
+class FixedMessageView
+{
+protected:
+  MessageView msg;
+public:
+  explicit FixedMessageView(const MessageView &view) : msg(view) {}
+  bool valid() const { return msg.type() == Type && msg.size() == Size; }
+};
+
+struct JoinView : FixedMessageView<E_CLIENT_TO_SERVER_JOIN, sizeof(uint16_t)>
+{
+  using FixedMessageView::FixedMessageView;
+  uint16_t version() const { return msg.get<uint16_t>(0); }
+};
+
+struct SetControlledEntityView : FixedMessageView<E_SERVER_TO_CLIENT_SET_CONTROLLED_ENTITY, sizeof(uint32_t)>
+{
+  using FixedMessageView::FixedMessageView;
+  uint32_t eid() const { return msg.get<uint32_t>(0); }
+};
+
+struct InputView : FixedMessageView<E_CLIENT_TO_SERVER_INPUT, sizeof(uint8_t)>
+{
+  using FixedMessageView::FixedMessageView;
+  uint8_t action() const { return msg.get<uint8_t>(0); }
+};
+
+struct AckView : FixedMessageView<E_CLIENT_TO_SERVER_ACK, sizeof(uint32_t)>
+{
+  using FixedMessageView::FixedMessageView;
+  uint32_t turn() const { return msg.get<uint32_t>(0); }
+};
+
+// Iterates messages of a received datagram
+class PacketReader
+{
+  const uint8_t *data;
+  size_t size;
+  size_t offset = 0;
+public:
+  PacketReader(const uint8_t *in_data, size_t in_size) : data(in_data), size(in_size) {}
+
+  // false at the end of the datagram or on a truncated message, unknown types come out as E_NUM_MESSAGES
+  bool next(MessageView &msg);
+  // the whole datagram was consumed, there was no truncated message at its end
+  bool finished() const { return offset == size; }
+};
+
+// fails if the snapshot's baseline is missing from the history
+bool deserialize_snapshot(const MessageView &msg, const SnapshotHistory &history, SnapshotState &snapshot);
 
+// random and mutated datagrams through the reader and views, returns number of failed round trips
+int run_protocol_fuzz(uint32_t iterations);
+// message iteration throughput over a buffer of batched small messages
+int run_protocol_benchmark(uint32_t num_messages);
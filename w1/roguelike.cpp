@@ -3,6 +3,7 @@
 #include <debugdraw/debugdraw.h>
 #include "stateMachine.h"
 #include "aiLibrary.h"
+#include "staticAiLibrary.h"
 #include "app.h"
 
 //for scancodes
@@ -10,42 +11,17 @@
 
 static void add_patrol_attack_flee_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
-  {
-    int patrol = sm.addState(create_patrol_state(3.f));
-    int moveToEnemy = sm.addState(create_move_to_enemy_state());
-    int fleeFromEnemy = sm.addState(create_flee_from_enemy_state());
-
-    sm.addTransition(create_enemy_available_transition(3.f), patrol, moveToEnemy);
-    sm.addTransition(create_negate_transition(create_enemy_available_transition(5.f)), moveToEnemy, patrol);
-
-    sm.addTransition(create_and_transition(create_hitpoints_less_than_transition(60.f), create_enemy_available_transition(5.f)),
-                     moveToEnemy, fleeFromEnemy);
-    sm.addTransition(create_and_transition(create_hitpoints_less_than_transition(60.f), create_enemy_available_transition(3.f)),
-                     patrol, fleeFromEnemy);
-
-    sm.addTransition(create_negate_transition(create_enemy_available_transition(7.f)), fleeFromEnemy, patrol);
-  });
+  entity.set(PatrolAttackFleeSm{});
 }
 
 static void add_patrol_flee_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
-  {
-    int patrol = sm.addState(create_patrol_state(3.f));
-    int fleeFromEnemy = sm.addState(create_flee_from_enemy_state());
-
-    sm.addTransition(create_enemy_available_transition(3.f), patrol, fleeFromEnemy);
-    sm.addTransition(create_negate_transition(create_enemy_available_transition(5.f)), fleeFromEnemy, patrol);
-  });
+  entity.set(PatrolFleeSm{});
 }
 
 static void add_attack_sm(flecs::entity entity)
 {
-  entity.get([](StateMachine &sm)
-  {
-    sm.addState(create_move_to_enemy_state());
-  });
+  entity.set(AttackSm{});
 }
 
 static flecs::entity create_monster(flecs::world &ecs, int x, int y, uint32_t color)
@@ -57,15 +33,14 @@ static flecs::entity create_monster(flecs::world &ecs, int x, int y, uint32_t co
     .set(Hitpoints{100.f})
     .set(Action{EA_NOP})
     .set(Color{color})
-    .set(StateMachine{})
     .set(Team{1})
     .set(NumActions{1, 0})
     .set(MeleeDamage{20.f});
 }
 
-static void create_player(flecs::world &ecs, int x, int y)
+flecs::entity create_player(flecs::world &ecs, int x, int y, const char *name)
 {
-  ecs.entity("player")
+  return ecs.entity(name)
     .set(Position{x, y})
     .set(MovePos{x, y})
     .set(Hitpoints{100.f})
@@ -130,16 +105,20 @@ static void register_roguelike_systems(flecs::world &ecs)
 }
 
 
-void init_roguelike(flecs::world &ecs)
+void init_roguelike(flecs::world &ecs, bool server)
 {
-  register_roguelike_systems(ecs);
+  if (!server)
+    register_roguelike_systems(ecs);
+
+  ecs.set(TurnCounter{});
 
   add_patrol_attack_flee_sm(create_monster(ecs, 5, 5, 0xffee00ee));
   add_patrol_attack_flee_sm(create_monster(ecs, 10, -5, 0xffee00ee));
   add_patrol_flee_sm(create_monster(ecs, -5, -5, 0xff111111));
   add_attack_sm(create_monster(ecs, -5, 5, 0xff00ff00));
 
-  create_player(ecs, 0, 0);
+  if (!server)
+    create_player(ecs, 0, 0, "player");
 
   create_powerup(ecs, 7, 7, 10.f);
   create_powerup(ecs, 10, -6, 10.f);
@@ -255,24 +234,42 @@ static void process_actions(flecs::world &ecs)
   });
 }
 
-void process_turn(flecs::world &ecs)
+template<typename Sm>
+static void act_static_sm(flecs::world &ecs)
+{
+  static auto smAct = ecs.query<Sm>();
+  smAct.each([&](flecs::entity e, Sm &sm)
+  {
+    sm.act(ecs, e);
+  });
+}
+
+void simulate_turn(flecs::world &ecs, bool npcs_act)
 {
   static auto stateMachineAct = ecs.query<StateMachine>();
-  if (is_player_acted(ecs))
+  if (npcs_act)
   {
-    if (upd_player_actions_count(ecs))
+    // Plan action for NPCs
+    ecs.defer([&]
     {
-      // Plan action for NPCs
-      ecs.defer([&]
+      // runtime built machines
+      stateMachineAct.each([&](flecs::entity e, StateMachine &sm)
       {
-        stateMachineAct.each([&](flecs::entity e, StateMachine &sm)
-        {
-          sm.act(0.f, ecs, e);
-        });
+        sm.act(0.f, ecs, e);
       });
-    }
-    process_actions(ecs);
+      act_static_sm<PatrolAttackFleeSm>(ecs);
+      act_static_sm<PatrolFleeSm>(ecs);
+      act_static_sm<AttackSm>(ecs);
+    });
   }
+  process_actions(ecs);
+  ecs.get_mut<TurnCounter>()->turn++;
+}
+
+void process_turn(flecs::world &ecs)
+{
+  if (is_player_acted(ecs))
+    simulate_turn(ecs, upd_player_actions_count(ecs));
 }
 
 void print_stats(flecs::world &ecs)
@@ -2,6 +2,11 @@
 
 #include <flecs.h>
 
-void init_roguelike(flecs::world &ecs);
+// server mode skips input/render systems and the local player, players are spawned per client
+void init_roguelike(flecs::world &ecs, bool server = false);
+flecs::entity create_player(flecs::world &ecs, int x, int y, const char *name = nullptr);
+// advances the local game when the player acted
 void process_turn(flecs::world &ecs);
+// unconditionally simulates one turn, npcs_act plans NPC actions first
+void simulate_turn(flecs::world &ecs, bool npcs_act);
 void print_stats(flecs::world &ecs);
@@ -0,0 +1,290 @@
+#include "server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <flecs.h>
+#include "ecsTypes.h"
+#include "roguelike.h"
+#include "protocol.h"
+#include "rng.h"
+
+static constexpr int interest_cell_shift = 3; // 8x8 tiles per cell
+static constexpr int interest_radius = 2;     // in cells around the player's cell
+static constexpr auto turn_interval = std::chrono::milliseconds(100);
+static constexpr auto client_timeout = std::chrono::seconds(5);
+
+class InterestGrid
+{
+  // cells are only cleared between turns, so their storage is reused
+  std::unordered_map<uint64_t, std::vector<Entity>> cells;
+
+  static uint64_t cell_key(int cx, int cy)
+  {
+    return uint64_t(uint32_t(cx)) | (uint64_t(uint32_t(cy)) << 32);
+  }
+public:
+  void build(flecs::world &ecs)
+  {
+    static auto entitiesQuery = ecs.query<const Position, const Color>();
+    for (auto &cell : cells)
+      cell.second.clear();
+    entitiesQuery.each([&](flecs::entity e, const Position &pos, const Color &color)
+    {
+      cells[cell_key(pos.x >> interest_cell_shift, pos.y >> interest_cell_shift)]
+        .push_back(Entity{color.color, pos.x, pos.y, uint32_t(e.id())});
+    });
+  }
+
+  void gather(const Position &center, std::vector<Entity> &out) const
+  {
+    out.clear();
+    const int cx = center.x >> interest_cell_shift;
+    const int cy = center.y >> interest_cell_shift;
+    for (int y = cy - interest_radius; y <= cy + interest_radius; ++y)
+      for (int x = cx - interest_radius; x <= cx + interest_radius; ++x)
+      {
+        auto itf = cells.find(cell_key(x, y));
+        if (itf != cells.end())
+          out.insert(out.end(), itf->second.begin(), itf->second.end());
+      }
+  }
+};
+
+struct ServerClient
+{
+  NetAddress addr;
+  std::chrono::steady_clock::time_point lastReceived;
+  int spawnSlot = 0; // players of leaving clients free their slot for the next one joining
+  flecs::entity player;
+  Position lastPos;
+  uint8_t input = EA_NOP;
+  // sent snapshots stay around until acknowledged, the latest acked one is the delta baseline
+  SnapshotHistory history;
+  uint32_t ackedTurn = no_baseline;
+  uint64_t bytesSent = 0;
+  uint64_t entitiesSent = 0;
+};
+
+static int free_spawn_slot(const std::vector<ServerClient> &clients)
+{
+  int slot = 0;
+  while (std::any_of(clients.begin(), clients.end(), [&](const ServerClient &c) { return c.spawnSlot == slot; }))
+    slot++;
+  return slot;
+}
+
+// the new player is announced with the next datagram written to the client
+static void spawn_client_player(flecs::world &ecs, PacketWriter &writer, ServerClient &client)
+{
+  client.player = create_player(ecs, client.spawnSlot * 2, 0);
+  client.lastPos = *client.player.get<Position>();
+  writer.setControlledEntity(uint32_t(client.player.id()));
+}
+
+int run_server(uint16_t port, uint32_t max_turns)
+{
+  UdpSocket sock;
+  if (!sock.open(port))
+  {
+    fprintf(stderr, "cannot open server socket on port %u\n", unsigned(port));
+    return 1;
+  }
+  flecs::world ecs;
+  init_roguelike(ecs, true);
+  ecs.set(WorldSeed{uint64_t(port)});
+
+  std::vector<ServerClient> clients;
+  InterestGrid grid;
+  SnapshotState snapshot;
+  PacketWriter writer;
+  std::vector<uint8_t> packet(max_packet_size);
+  uint32_t turn = 0;
+  auto nextTurn = std::chrono::steady_clock::now() + turn_interval;
+  while (max_turns == 0 || turn < max_turns)
+  {
+    NetAddress from;
+    for (size_t size; (size = sock.receive(packet.data(), packet.size(), from)) > 0;)
+    {
+      const auto now = std::chrono::steady_clock::now();
+      auto client = std::find_if(clients.begin(), clients.end(), [&](const ServerClient &c) { return c.addr == from; });
+      if (client != clients.end())
+        client->lastReceived = now;
+      PacketReader reader(packet.data(), size);
+      for (MessageView msg; reader.next(msg);)
+      {
+        if (JoinView(msg).valid() && JoinView(msg).version() == protocol_version)
+        {
+          if (client == clients.end())
+          {
+            ServerClient newClient;
+            newClient.addr = from;
+            newClient.lastReceived = now;
+            newClient.spawnSlot = free_spawn_slot(clients);
+            clients.push_back(newClient);
+            client = clients.end() - 1;
+            spawn_client_player(ecs, writer, *client);
+          }
+          else // join got resent, the answer was probably lost
+            writer.setControlledEntity(uint32_t(client->player.id()));
+          writer.send(sock, from);
+        }
+        else if (client == clients.end())
+          break;
+        else if (msg.type() == E_CLIENT_TO_SERVER_LEAVE)
+        {
+          if (client->player.is_alive())
+            client->player.destruct();
+          clients.erase(client);
+          break;
+        }
+        else if (InputView(msg).valid())
+          client->input = InputView(msg).action();
+        else if (AckView(msg).valid())
+        {
+          const uint32_t acked = AckView(msg).turn();
+          // acks can arrive out of order, never move the baseline back
+          if (acked < turn && (client->ackedTurn == no_baseline || acked > client->ackedTurn))
+            client->ackedTurn = acked;
+        }
+      }
+    }
+
+    if (std::chrono::steady_clock::now() < nextTurn)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    nextTurn += turn_interval;
+
+    // clients that went away without a leave message (crashed, lost connection)
+    const auto now = std::chrono::steady_clock::now();
+    clients.erase(std::remove_if(clients.begin(), clients.end(), [&](ServerClient &client)
+      {
+        if (now - client.lastReceived < client_timeout)
+          return false;
+        printf("server: client %u timed out\n", unsigned(client.addr.port));
+        if (client.player.is_alive())
+          client.player.destruct();
+        return true;
+      }), clients.end());
+
+    for (ServerClient &client : clients)
+    {
+      if (client.player.is_alive())
+        client.player.set(Action{client.input});
+      client.input = EA_NOP;
+    }
+    simulate_turn(ecs, true);
+
+    grid.build(ecs);
+    for (ServerClient &client : clients)
+    {
+      if (!client.player.is_alive())
+        spawn_client_player(ecs, writer, client);
+      client.lastPos = *client.player.get<Position>();
+      snapshot.turn = turn;
+      snapshot.originX = client.lastPos.x;
+      snapshot.originY = client.lastPos.y;
+      grid.gather(client.lastPos, snapshot.ents);
+      std::sort(snapshot.ents.begin(), snapshot.ents.end(), [](const Entity &a, const Entity &b) { return a.eid < b.eid; });
+      // too old a baseline has left the history, the snapshot is sent in full then
+      const SnapshotState *baseline = client.history.find(client.ackedTurn);
+      client.bytesSent += writer.snapshot(snapshot, baseline).send(sock, client.addr);
+      client.entitiesSent += snapshot.ents.size();
+      client.history.store(snapshot);
+    }
+    turn++;
+  }
+
+  for (const ServerClient &client : clients)
+    printf("server: client %u: %.1f bytes/turn, %.1f entities/turn\n", unsigned(client.addr.port),
+           double(client.bytesSent) / double(turn), double(client.entitiesSent) / double(turn));
+  return 0;
+}
+
+int run_bot_client(uint16_t server_port, uint32_t max_turns)
+{
+  UdpSocket sock;
+  if (!sock.open(0))
+  {
+    fprintf(stderr, "cannot open client socket\n");
+    return 1;
+  }
+  const NetAddress server = loopback_address(server_port);
+  const uint64_t seed = sock.localPort();
+
+  std::vector<uint8_t> packet(max_packet_size);
+  SnapshotHistory history;
+  SnapshotState snapshot;
+  PacketWriter writer;
+  uint32_t controlled = invalid_entity;
+  uint32_t lastTurn = ~0u;
+  uint32_t turns = 0;
+  uint64_t bytesReceived = 0;
+  uint64_t entitiesReceived = 0;
+  auto lastPacket = std::chrono::steady_clock::now();
+  auto lastJoin = lastPacket - client_timeout;
+  while (turns < max_turns && std::chrono::steady_clock::now() - lastPacket < client_timeout)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    if (controlled == invalid_entity && now - lastJoin > std::chrono::milliseconds(500))
+    {
+      writer.join().send(sock, server);
+      lastJoin = now;
+    }
+
+    NetAddress from;
+    const size_t size = sock.receive(packet.data(), packet.size(), from);
+    if (size == 0)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    lastPacket = now;
+    bytesReceived += size;
+    PacketReader reader(packet.data(), size);
+    for (MessageView msg; reader.next(msg);)
+    {
+      if (SetControlledEntityView(msg).valid())
+        controlled = SetControlledEntityView(msg).eid();
+      else if (deserialize_snapshot(msg, history, snapshot))
+      {
+        history.store(snapshot);
+        writer.ack(snapshot.turn);
+        entitiesReceived += snapshot.ents.size();
+        if (snapshot.turn != lastTurn)
+        {
+          lastTurn = snapshot.turn;
+          turns++;
+          CounterRng rng(seed, controlled, snapshot.turn);
+          writer.input(uint8_t(rng.range(EA_MOVE_START, EA_MOVE_END - 1)));
+        }
+      }
+    }
+    // ack and input go out together
+    writer.send(sock, server);
+  }
+  writer.leave().send(sock, server);
+  printf("client %u: %u turns, %.1f bytes/turn, %.1f entities/turn\n", unsigned(sock.localPort()), turns,
+         turns ? double(bytesReceived) / double(turns) : 0.0, turns ? double(entitiesReceived) / double(turns) : 0.0);
+  return turns == max_turns ? 0 : 1;
+}
+
+int run_loopback_session(uint16_t port, int num_clients, uint32_t max_turns)
+{
+  std::vector<std::thread> clientThreads;
+  std::vector<int> results(size_t(num_clients), 1);
+  for (int i = 0; i < num_clients; ++i)
+    clientThreads.emplace_back([&, i] { results[size_t(i)] = run_bot_client(port, max_turns); });
+  // a few spare turns so late joiners still get all of theirs
+  const int serverRes = run_server(port, max_turns + 20);
+  for (std::thread &t : clientThreads)
+    t.join();
+  for (int res : results)
+    if (res != 0)
+      return res;
+  return serverRes;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+// Headless authoritative server: clients join over UDP, send their inputs and get per-turn
+// snapshots of the entities inside their area of interest only. Entities are bucketed into a
+// coarse grid once per turn, so each client costs a lookup of the few cells around its player.
+// Snapshots are delta encoded against the last one the client acknowledged.
+int run_server(uint16_t port, uint32_t max_turns);
+// Headless client sending random inputs, reports what it received
+int run_bot_client(uint16_t server_port, uint32_t max_turns);
+// Server plus num_clients bot clients over loopback in a single process
+int run_loopback_session(uint16_t port, int num_clients, uint32_t max_turns);
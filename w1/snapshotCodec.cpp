@@ -0,0 +1,323 @@
+#include "snapshotCodec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "rng.h"
+
+enum SnapshotOp : uint32_t
+{
+  SO_REMOVE = 0,
+  SO_MOVE,
+  SO_FULL
+};
+
+static constexpr size_t snapshot_header_size = 4 * sizeof(uint32_t);
+
+// positions are wrapped to 32 bits on both ends, so garbage input can't overflow
+static int32_t wrapping_add(int32_t a, int32_t b) { return int32_t(uint32_t(a) + uint32_t(b)); }
+static int32_t wrapping_sub(int32_t a, int32_t b) { return int32_t(uint32_t(a) - uint32_t(b)); }
+
+class BitWriter
+{
+  std::vector<uint8_t> &buf;
+  uint64_t acc = 0;
+  int numBits = 0;
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : buf(out) {}
+
+  void write(uint32_t val, int bits)
+  {
+    acc |= uint64_t(val) << numBits;
+    numBits += bits;
+    while (numBits >= 8)
+    {
+      buf.push_back(uint8_t(acc));
+      acc >>= 8;
+      numBits -= 8;
+    }
+  }
+
+  // Elias gamma, val >= 1
+  void writeGamma(uint32_t val)
+  {
+    int n = 0;
+    while ((val >> n) > 1)
+      n++;
+    write(0, n);
+    write(1, 1);
+    write(val & ((1u << n) - 1), n);
+  }
+
+  void writeSigned(int32_t val)
+  {
+    // zigzag keeps small magnitudes of both signs short
+    writeGamma(((uint32_t(val) << 1) ^ uint32_t(val >> 31)) + 1);
+  }
+
+  void flush()
+  {
+    if (numBits > 0)
+      buf.push_back(uint8_t(acc));
+    acc = 0;
+    numBits = 0;
+  }
+};
+
+class BitReader
+{
+  const uint8_t *data;
+  size_t size;
+  size_t bitPos = 0;
+public:
+  bool overflow = false;
+
+  BitReader(const uint8_t *in_data, size_t in_size) : data(in_data), size(in_size) {}
+
+  uint32_t read(int bits)
+  {
+    uint32_t res = 0;
+    for (int i = 0; i < bits; ++i, ++bitPos)
+    {
+      if ((bitPos >> 3) >= size)
+      {
+        overflow = true;
+        return 0;
+      }
+      res |= uint32_t((data[bitPos >> 3] >> (bitPos & 7)) & 1) << i;
+    }
+    return res;
+  }
+
+  uint32_t readGamma()
+  {
+    int n = 0;
+    while (!overflow && read(1) == 0)
+      if (++n > 31)
+        overflow = true;
+    if (overflow)
+      return 0;
+    return (1u << n) | read(n);
+  }
+
+  int32_t readSigned()
+  {
+    const uint32_t zigzag = readGamma() - 1;
+    return int32_t(zigzag >> 1) ^ -int32_t(zigzag & 1);
+  }
+};
+
+template<typename T>
+static void put(std::vector<uint8_t> &out, const T &val)
+{
+  const size_t at = out.size();
+  out.resize(at + sizeof(T));
+  memcpy(out.data() + at, &val, sizeof(T));
+}
+
+template<typename T>
+static const uint8_t *get(const uint8_t *ptr, T &val)
+{
+  memcpy(&val, ptr, sizeof(T));
+  return ptr + sizeof(T);
+}
+
+void encode_snapshot(const SnapshotState &snapshot, const SnapshotState *baseline, std::vector<uint8_t> &out)
+{
+  static const std::vector<Entity> empty;
+  const std::vector<Entity> &cur = snapshot.ents;
+  const std::vector<Entity> &base = baseline ? baseline->ents : empty;
+  put(out, snapshot.turn);
+  put(out, baseline ? baseline->turn : no_baseline);
+  put(out, snapshot.originX);
+  put(out, snapshot.originY);
+
+  struct Entry
+  {
+    uint32_t op;
+    const Entity *ent;
+    const Entity *prev;
+  };
+  // merge both eid sorted lists, only differences become entries
+  static thread_local std::vector<Entry> entries;
+  entries.clear();
+  size_t i = 0, j = 0;
+  while (i < cur.size() || j < base.size())
+  {
+    if (j == base.size() || (i < cur.size() && cur[i].eid < base[j].eid))
+      entries.push_back(Entry{SO_FULL, &cur[i++], nullptr});
+    else if (i == cur.size() || base[j].eid < cur[i].eid)
+      entries.push_back(Entry{SO_REMOVE, &base[j++], nullptr});
+    else
+    {
+      const Entity &c = cur[i++];
+      const Entity &b = base[j++];
+      if (c.color != b.color)
+        entries.push_back(Entry{SO_FULL, &c, nullptr});
+      else if (c.x != b.x || c.y != b.y)
+        entries.push_back(Entry{SO_MOVE, &c, &b});
+    }
+  }
+
+  BitWriter writer(out);
+  writer.writeGamma(uint32_t(entries.size()) + 1);
+  uint32_t prevEid = 0;
+  uint32_t prevColor = 0;
+  for (const Entry &entry : entries)
+  {
+    writer.writeGamma(entry.ent->eid - prevEid + 1);
+    prevEid = entry.ent->eid;
+    writer.write(entry.op, 2);
+    if (entry.op == SO_MOVE)
+    {
+      writer.writeSigned(wrapping_sub(entry.ent->x, entry.prev->x));
+      writer.writeSigned(wrapping_sub(entry.ent->y, entry.prev->y));
+    }
+    else if (entry.op == SO_FULL)
+    {
+      writer.writeSigned(wrapping_sub(entry.ent->x, snapshot.originX));
+      writer.writeSigned(wrapping_sub(entry.ent->y, snapshot.originY));
+      writer.write(entry.ent->color == prevColor ? 1 : 0, 1);
+      if (entry.ent->color != prevColor)
+        writer.write(entry.ent->color, 32);
+      prevColor = entry.ent->color;
+    }
+  }
+  writer.flush();
+}
+
+bool same_entities(const std::vector<Entity> &a, const std::vector<Entity> &b)
+{
+  return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(Entity)) == 0);
+}
+
+bool decode_snapshot(const uint8_t *data, size_t size, const SnapshotHistory &history, SnapshotState &snapshot)
+{
+  if (size < snapshot_header_size)
+    return false;
+  uint32_t baselineTurn = no_baseline;
+  const uint8_t *ptr = data;
+  ptr = get(ptr, snapshot.turn);
+  ptr = get(ptr, baselineTurn);
+  ptr = get(ptr, snapshot.originX);
+  ptr = get(ptr, snapshot.originY);
+  const SnapshotState *baseline = history.find(baselineTurn);
+  if (baselineTurn != no_baseline && !baseline)
+    return false;
+
+  static const std::vector<Entity> empty;
+  const std::vector<Entity> &base = baseline ? baseline->ents : empty;
+  std::vector<Entity> &cur = snapshot.ents;
+  cur.clear();
+  cur.reserve(base.size());
+
+  BitReader reader(ptr, size - snapshot_header_size);
+  const uint32_t numEntries = reader.readGamma() - 1;
+  uint32_t eid = 0;
+  uint32_t prevColor = 0;
+  size_t j = 0;
+  for (uint32_t e = 0; e < numEntries && !reader.overflow; ++e)
+  {
+    eid += reader.readGamma() - 1;
+    const uint32_t op = reader.read(2);
+    // untouched baseline entities before this one are carried over as is
+    while (j < base.size() && base[j].eid < eid)
+      cur.push_back(base[j++]);
+    const Entity *prev = j < base.size() && base[j].eid == eid ? &base[j++] : nullptr;
+    if (op == SO_MOVE)
+    {
+      if (!prev)
+        return false;
+      Entity ent = *prev;
+      ent.x = wrapping_add(ent.x, reader.readSigned());
+      ent.y = wrapping_add(ent.y, reader.readSigned());
+      cur.push_back(ent);
+    }
+    else if (op == SO_FULL)
+    {
+      Entity ent;
+      ent.eid = eid;
+      ent.x = wrapping_add(snapshot.originX, reader.readSigned());
+      ent.y = wrapping_add(snapshot.originY, reader.readSigned());
+      ent.color = reader.read(1) ? prevColor : reader.read(32);
+      prevColor = ent.color;
+      cur.push_back(ent);
+    }
+    else if (op != SO_REMOVE || !prev)
+      return false;
+  }
+  cur.insert(cur.end(), base.begin() + ptrdiff_t(j), base.end());
+  return !reader.overflow;
+}
+
+int run_snapshot_benchmark(int num_entities, int num_turns)
+{
+  SnapshotHistory serverHistory;
+  SnapshotHistory clientHistory;
+  SnapshotState state;
+  SnapshotState decoded;
+  state.turn = 0;
+  uint32_t nextEid = 0;
+  for (int i = 0; i < num_entities; ++i)
+  {
+    CounterRng rng(0, nextEid, 0);
+    state.ents.push_back(Entity{uint32_t(rng.range(0, 3)) * 0x40404040u, rng.range(-20, 20), rng.range(-20, 20), nextEid++});
+  }
+
+  std::vector<uint8_t> packet;
+  size_t fullBytes = 0;
+  size_t deltaBytes = 0;
+  size_t deltaEntities = 0;
+  double encodeTime = 0.0;
+  double decodeTime = 0.0;
+  int failures = 0;
+  for (int turn = 0; turn < num_turns; ++turn)
+  {
+    state.turn = uint32_t(turn);
+    if (turn > 0)
+    {
+      // a third of entities move, a few die and get replaced by new ones
+      for (size_t i = 0; i < state.ents.size(); ++i)
+      {
+        CounterRng rng(1, state.ents[i].eid, uint64_t(turn));
+        const int roll = rng.range(0, 99);
+        if (roll < 33)
+          (rng.range(0, 1) ? state.ents[i].x : state.ents[i].y) += rng.range(0, 1) ? 1 : -1;
+        else if (roll == 99)
+          state.ents[i] = Entity{state.ents[i].color, state.ents[i].x, state.ents[i].y, nextEid++};
+      }
+      std::sort(state.ents.begin(), state.ents.end(), [](const Entity &a, const Entity &b) { return a.eid < b.eid; });
+    }
+
+    const SnapshotState *baseline = turn > 0 ? serverHistory.find(uint32_t(turn - 1)) : nullptr;
+    packet.clear();
+    auto start = std::chrono::steady_clock::now();
+    encode_snapshot(state, baseline, packet);
+    encodeTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    serverHistory.store(state);
+
+    start = std::chrono::steady_clock::now();
+    const bool ok = decode_snapshot(packet.data(), packet.size(), clientHistory, decoded);
+    decodeTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok || !same_entities(decoded.ents, state.ents))
+      failures++;
+    clientHistory.store(decoded);
+
+    if (baseline)
+    {
+      deltaBytes += packet.size();
+      deltaEntities += state.ents.size();
+    }
+    else
+      fullBytes += packet.size();
+  }
+
+  const double totalEntities = double(num_entities) * double(num_turns);
+  printf("full snapshot: %.2f bytes/entity (raw %zu)\n", double(fullBytes) / double(num_entities), sizeof(Entity));
+  if (deltaEntities > 0)
+    printf("delta snapshot: %.3f bytes/entity, %.0f bytes/packet\n", double(deltaBytes) / double(deltaEntities),
+           double(deltaBytes) / double(num_turns - 1));
+  printf("encode: %.1f M entities/s, decode: %.1f M entities/s, %d failed round trips\n",
+         totalEntities / encodeTime * 1e-6, totalEntities / decodeTime * 1e-6, failures);
+  return failures == 0 ? 0 : 1;
+}
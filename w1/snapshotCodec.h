@@ -0,0 +1,45 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "entity.h"
+
+constexpr uint32_t no_baseline = ~0u;
+
+// Everything a client sees on a turn, entities are sorted by eid
+struct SnapshotState
+{
+  uint32_t turn = no_baseline;
+  int32_t originX = 0;
+  int32_t originY = 0;
+  std::vector<Entity> ents;
+};
+
+// Last few snapshots by turn, used as delta baselines on both ends
+class SnapshotHistory
+{
+  static constexpr size_t history_size = 32;
+  std::array<SnapshotState, history_size> ring;
+public:
+  const SnapshotState *find(uint32_t turn) const
+  {
+    const SnapshotState &st = ring[turn % history_size];
+    return turn != no_baseline && st.turn == turn ? &st : nullptr;
+  }
+  void store(const SnapshotState &st) { ring[st.turn % history_size] = st; }
+};
+
+// Snapshot layout: u32 turn, u32 baseline turn, i32 origin x, i32 origin y, then a bit stream:
+//   gamma(entries + 1), per entry: gamma(eid - prev eid + 1), 2 bit op and op data
+//     remove: nothing
+//     move:   signed(dx), signed(dy) against the baseline position
+//     full:   signed(x - origin x), signed(y - origin y), 1 bit "same color as previous full entry" or u32 color
+// Entities unchanged since the baseline aren't written at all, a missing baseline means a full snapshot.
+void encode_snapshot(const SnapshotState &snapshot, const SnapshotState *baseline, std::vector<uint8_t> &out);
+// history provides the baseline, returns false on corrupted data or a missing baseline
+bool decode_snapshot(const uint8_t *data, size_t size, const SnapshotHistory &history, SnapshotState &snapshot);
+bool same_entities(const std::vector<Entity> &a, const std::vector<Entity> &b);
+
+// encodes a random walk over many turns and checks decoding, prints sizes and throughput
+int run_snapshot_benchmark(int num_entities, int num_turns);
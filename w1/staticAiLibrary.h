@@ -0,0 +1,47 @@
+#pragma once
+#include "staticStateMachine.h"
+#include "aiUtils.h"
+
+// states, distances are in tiles
+struct MoveToEnemy
+{
+  void act(flecs::world &ecs, flecs::entity entity) const { move_to_enemy(ecs, entity); }
+};
+
+struct FleeFromEnemy
+{
+  void act(flecs::world &ecs, flecs::entity entity) const { flee_from_enemy(ecs, entity); }
+};
+
+template<int PatrolDist>
+struct Patrol
+{
+  void act(flecs::world &ecs, flecs::entity entity) const { patrol(ecs, entity, float(PatrolDist)); }
+};
+
+// transitions
+template<int Dist>
+struct EnemyAvailable
+{
+  static bool isAvailable(flecs::world &ecs, flecs::entity entity) { return is_enemy_available(ecs, entity, float(Dist)); }
+};
+
+template<int Threshold>
+struct HitpointsLessThan
+{
+  static bool isAvailable(flecs::world &, flecs::entity entity) { return is_hitpoints_less_than(entity, float(Threshold)); }
+};
+
+// machines used by monsters, each one is a component of its own
+using PatrolAttackFleeSm = StaticStateMachine<StateList<Patrol<3>, MoveToEnemy, FleeFromEnemy>,
+  Transition<Patrol<3>, EnemyAvailable<3>, MoveToEnemy>,
+  Transition<MoveToEnemy, Not<EnemyAvailable<5>>, Patrol<3>>,
+  Transition<MoveToEnemy, And<HitpointsLessThan<60>, EnemyAvailable<5>>, FleeFromEnemy>,
+  Transition<Patrol<3>, And<HitpointsLessThan<60>, EnemyAvailable<3>>, FleeFromEnemy>,
+  Transition<FleeFromEnemy, Not<EnemyAvailable<7>>, Patrol<3>>>;
+
+using PatrolFleeSm = StaticStateMachine<StateList<Patrol<3>, FleeFromEnemy>,
+  Transition<Patrol<3>, EnemyAvailable<3>, FleeFromEnemy>,
+  Transition<FleeFromEnemy, Not<EnemyAvailable<5>>, Patrol<3>>>;
+
+using AttackSm = StaticStateMachine<StateList<MoveToEnemy>>;
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <type_traits>
+#include <variant>
+#include <flecs.h>
+
+// State machine composed from types at compile time, the counterpart of the runtime built StateMachine.
+// States are types with act(ecs, entity) and optional enter()/exit(), conditions are types with
+// static bool isAvailable(ecs, entity). The current state lives in a std::variant, so a machine is a
+// single small value without any heap allocations and every state/transition call is inlined.
+//
+//   using Sm = StaticStateMachine<StateList<Patrol<3>, MoveToEnemy>,
+//                                 Transition<Patrol<3>, EnemyAvailable<3>, MoveToEnemy>,
+//                                 Transition<MoveToEnemy, Not<EnemyAvailable<5>>, Patrol<3>>>;
+//
+// The first state of the list is the initial one. Transitions are checked in declaration order,
+// the first available one is taken, then the (possibly new) state acts, same as StateMachine::act.
+
+template<typename... States>
+struct StateList {};
+
+template<typename From, typename Condition, typename To>
+struct Transition
+{
+  using from = From;
+  using condition = Condition;
+  using to = To;
+};
+
+template<typename States, typename... Transitions>
+class StaticStateMachine;
+
+template<typename... States, typename... Transitions>
+class StaticStateMachine<StateList<States...>, Transitions...>
+{
+  using StateVariant = std::variant<States...>;
+  StateVariant state;
+
+  template<typename Trans, typename Cur>
+  bool tryTransition(flecs::world &ecs, flecs::entity entity, Cur &cur)
+  {
+    // resolved at compile time, a state only ever checks its own transitions
+    if constexpr (!std::is_same_v<typename Trans::from, Cur>)
+      return false;
+    else
+    {
+      static_assert(std::disjunction_v<std::is_same<typename Trans::to, States>...>, "transition to an unknown state");
+      if (!Trans::condition::isAvailable(ecs, entity))
+        return false;
+      if constexpr (requires { cur.exit(); })
+        cur.exit();
+      auto &next = state.template emplace<typename Trans::to>();
+      if constexpr (requires { next.enter(); })
+        next.enter();
+      return true;
+    }
+  }
+
+public:
+  void act(flecs::world &ecs, flecs::entity entity)
+  {
+    if constexpr (sizeof...(Transitions) > 0)
+      std::visit([&](auto &cur) { (tryTransition<Transitions>(ecs, entity, cur) || ...); }, state);
+    std::visit([&](auto &cur) { cur.act(ecs, entity); }, state);
+  }
+
+  size_t getCurState() const { return state.index(); }
+};
+
+template<typename Condition>
+struct Not
+{
+  static bool isAvailable(flecs::world &ecs, flecs::entity entity) { return !Condition::isAvailable(ecs, entity); }
+};
+
+template<typename Lhs, typename Rhs>
+struct And
+{
+  static bool isAvailable(flecs::world &ecs, flecs::entity entity)
+  {
+    return Lhs::isAvailable(ecs, entity) && Rhs::isAvailable(ecs, entity);
+  }
+};
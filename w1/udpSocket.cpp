@@ -0,0 +1,116 @@
+#include "udpSocket.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using socklen_t = int;
+using io_size_t = int;
+static constexpr uintptr_t invalid_socket = ~uintptr_t(0);
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using io_size_t = size_t;
+static constexpr int invalid_socket = -1;
+#endif
+#include <cstring>
+
+static io_size_t io_size(size_t size)
+{
+#ifdef _WIN32
+  return int(size);
+#else
+  return size;
+#endif
+}
+
+static sockaddr_in to_sockaddr(const NetAddress &addr)
+{
+  sockaddr_in res;
+  memset(&res, 0, sizeof(res));
+  res.sin_family = AF_INET;
+  res.sin_addr.s_addr = htonl(addr.host);
+  res.sin_port = htons(addr.port);
+  return res;
+}
+
+UdpSocket::~UdpSocket()
+{
+  close();
+}
+
+bool UdpSocket::open(uint16_t port)
+{
+  close();
+#ifdef _WIN32
+  static const bool wsaInitialized = []
+  {
+    WSADATA wsaData;
+    return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+  }();
+  if (!wsaInitialized)
+    return false;
+#endif
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock == invalid_socket)
+    return false;
+  const sockaddr_in addr = to_sockaddr(NetAddress{INADDR_ANY, port});
+  bool ok = bind(sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+#ifdef _WIN32
+  u_long nonBlocking = 1;
+  ok = ok && ioctlsocket(sock, FIONBIO, &nonBlocking) == 0;
+#else
+  ok = ok && fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+  if (!ok)
+    close();
+  return ok;
+}
+
+void UdpSocket::close()
+{
+  if (sock == invalid_socket)
+    return;
+#ifdef _WIN32
+  closesocket(sock);
+#else
+  ::close(sock);
+#endif
+  sock = invalid_socket;
+}
+
+bool UdpSocket::isOpen() const
+{
+  return sock != invalid_socket;
+}
+
+uint16_t UdpSocket::localPort() const
+{
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+    return 0;
+  return ntohs(addr.sin_port);
+}
+
+bool UdpSocket::sendTo(const NetAddress &addr, const void *data, size_t size)
+{
+  const sockaddr_in to = to_sockaddr(addr);
+  const auto sent = sendto(sock, static_cast<const char*>(data), io_size(size), 0,
+                           reinterpret_cast<const sockaddr*>(&to), sizeof(to));
+  return sent >= 0 && size_t(sent) == size;
+}
+
+size_t UdpSocket::receive(void *data, size_t capacity, NetAddress &from)
+{
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  const auto received = recvfrom(sock, static_cast<char*>(data), io_size(capacity), 0,
+                                 reinterpret_cast<sockaddr*>(&addr), &len);
+  if (received <= 0)
+    return 0;
+  from = NetAddress{ntohl(addr.sin_addr.s_addr), ntohs(addr.sin_port)};
+  return size_t(received);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+struct NetAddress
+{
+  uint32_t host = 0; // host byte order
+  uint16_t port = 0;
+
+  bool operator==(const NetAddress &rhs) const { return host == rhs.host && port == rhs.port; }
+};
+
+inline NetAddress loopback_address(uint16_t port)
+{
+  return NetAddress{0x7f000001u, port};
+}
+
+// Minimal non-blocking UDP socket, enough for loopback client/server sessions.
+class UdpSocket
+{
+#ifdef _WIN32
+  uintptr_t sock = ~uintptr_t(0);
+#else
+  int sock = -1;
+#endif
+public:
+  UdpSocket() = default;
+  UdpSocket(const UdpSocket &) = delete;
+  UdpSocket &operator=(const UdpSocket &) = delete;
+  ~UdpSocket();
+
+  // port 0 binds to any free port
+  bool open(uint16_t port);
+  void close();
+  bool isOpen() const;
+  uint16_t localPort() const;
+
+  bool sendTo(const NetAddress &addr, const void *data, size_t size);
+  // returns received size, 0 when there's nothing to read
+  size_t receive(void *data, size_t capacity, NetAddress &from);
+};
@@ -0,0 +1,154 @@
+#include "aiArchetypes.h"
+#include <cstring>
+#include "aiLibrary.h"
+#include "aiUtils.h"
+#include "blackboard.h"
+#include "bulkSpawn.h"
+#include "utilityAi.h"
+#include "goap.h"
+#include "mcts.h"
+#include "fov.h"
+
+static void create_minotaur_beh(flecs::entity e)
+{
+  e.set(Blackboard{});
+  add_self_sensors(e);
+  const BbSubscription hitpointsInput = BbSubscription().add<float>(reg_entity_blackboard_var<float>(e, "self_hp"));
+  BehNode *root =
+    selector({
+      sequence({
+        cached(is_low_hp(e, 50.f, "self_hp"), hitpointsInput),
+        find_enemy(e, 4.f, "flee_enemy"),
+        flee_co(e, "flee_enemy")
+      }),
+      sequence({
+        find_enemy(e, 3.f, "attack_enemy"),
+        move_to_entity_co(e, "attack_enemy")
+      }),
+      patrol_co(e, 2.f, "patrol_pos")
+    });
+  e.set(BehaviourTree{root});
+}
+
+static void add_minotaur_components(BulkSpawner &spawner)
+{
+  spawner.add<StateMachine>().add<Blackboard>().add<SelfSensors>().add<BehaviourTree>();
+}
+
+// brawlers go for heals when hurt, so they have to be able to collect them
+static void create_brawler_utility(flecs::entity e)
+{
+  e.set(UtilityAgent{UP_BRAWLER});
+  e.add<CanPickup>();
+  if (!e.has<PatrolPos>())
+  {
+    const Position *pos = e.get<Position>();
+    e.set(pos ? PatrolPos{pos->x, pos->y} : PatrolPos{});
+  }
+}
+
+static void add_brawler_components(BulkSpawner &spawner)
+{
+  spawner.add<UtilityAgent>().add<PatrolPos>().add<CanPickup>();
+}
+
+static void create_planner_goap(flecs::entity e)
+{
+  e.set(GoapAgent{});
+  e.add<CanPickup>();
+  if (!e.has<PatrolPos>())
+  {
+    const Position *pos = e.get<Position>();
+    e.set(pos ? PatrolPos{pos->x, pos->y} : PatrolPos{});
+  }
+}
+
+static void add_planner_components(BulkSpawner &spawner)
+{
+  spawner.add<GoapAgent>().add<PatrolPos>().add<CanPickup>();
+}
+
+// same patrol/attack/flee behaviour as the minotaur, but as a state machine
+static void create_guard_sm(flecs::entity e)
+{
+  e.add<StateMachine>();
+  e.set([](StateMachine &sm)
+  {
+    int patrol = sm.addState(create_patrol_state(2.f));
+    int moveToEnemy = sm.addState(create_move_to_enemy_state());
+    int fleeFromEnemy = sm.addState(create_flee_from_enemy_state());
+
+    sm.addTransition(create_enemy_available_transition(3.f), patrol, moveToEnemy);
+    sm.addTransition(create_negate_transition(create_enemy_available_transition(3.f)), moveToEnemy, patrol);
+
+    sm.addTransition(create_and_transition(create_hitpoints_less_than_transition(50.f), create_enemy_available_transition(4.f)),
+                     moveToEnemy, fleeFromEnemy);
+    sm.addTransition(create_and_transition(create_hitpoints_less_than_transition(50.f), create_enemy_available_transition(4.f)),
+                     patrol, fleeFromEnemy);
+
+    sm.addTransition(create_negate_transition(create_enemy_available_transition(4.f)), fleeFromEnemy, patrol);
+  });
+}
+
+static void add_guard_components(BulkSpawner &spawner)
+{
+  spawner.add<StateMachine>();
+}
+
+static void create_mcts_searcher(flecs::entity e)
+{
+  e.set(MctsAgent{});
+  e.add<CanPickup>();
+}
+
+static void add_mcts_components(BulkSpawner &spawner)
+{
+  spawner.add<MctsAgent>().add<CanPickup>();
+}
+
+struct AiArchetypeDesc
+{
+  const char *name;
+  void (*build)(flecs::entity e);
+  void (*addComponents)(BulkSpawner &spawner);
+};
+
+static const AiArchetypeDesc archetypes[AI_NUM] =
+{
+  {"none", nullptr, nullptr},
+  {"minotaur", create_minotaur_beh, add_minotaur_components},
+  {"brawler", create_brawler_utility, add_brawler_components},
+  {"planner", create_planner_goap, add_planner_components},
+  {"guard", create_guard_sm, add_guard_components},
+  {"mcts", create_mcts_searcher, add_mcts_components},
+};
+
+void apply_ai_archetype(flecs::entity e, uint8_t type)
+{
+  if (type >= AI_NUM)
+    return;
+  e.set(AiArchetype{type});
+  if (type != AI_NONE && !e.has<FieldOfView>())
+    e.add<FieldOfView>();
+  if (archetypes[type].build)
+    archetypes[type].build(e);
+}
+
+const char *ai_archetype_name(uint8_t type)
+{
+  return type < AI_NUM ? archetypes[type].name : "unknown";
+}
+
+void add_ai_archetype_components(BulkSpawner &spawner, uint8_t type)
+{
+  if (type < AI_NUM && archetypes[type].addComponents)
+    archetypes[type].addComponents(spawner);
+}
+
+uint8_t find_ai_archetype(const char *name)
+{
+  for (uint8_t i = 0; i < AI_NUM; ++i)
+    if (!strcmp(archetypes[i].name, name))
+      return i;
+  return AI_NUM;
+}
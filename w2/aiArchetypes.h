@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <flecs.h>
+
+class BulkSpawner;
+
+enum AiArchetypeType : uint8_t
+{
+  AI_NONE = 0,
+  AI_MINOTAUR,
+  AI_BRAWLER,
+  AI_PLANNER,
+  AI_GUARD,
+  AI_MCTS,
+  AI_NUM
+};
+
+// Remembers which behaviour an entity was built with, so that its
+// state machine/behaviour tree can be rebuilt (e.g. after loading a snapshot)
+struct AiArchetype
+{
+  uint8_t type = AI_NONE;
+};
+
+void apply_ai_archetype(flecs::entity e, uint8_t type);
+const char *ai_archetype_name(uint8_t type);
+// lets bulk spawning add the archetype components up front instead of moving entities between tables
+void add_ai_archetype_components(BulkSpawner &spawner, uint8_t type);
+// returns AI_NUM for unknown names
+uint8_t find_ai_archetype(const char *name);
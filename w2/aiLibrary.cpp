@@ -1,9 +1,12 @@
 #include "aiLibrary.h"
 #include <flecs.h>
 #include "ecsTypes.h"
-#include "raylib.h"
+#include "rng.h"
 #include "math.h"
 #include "aiUtils.h"
+#include "influenceMap.h"
+#include "fov.h"
+#include "queryCache.h"
 
 class AttackEnemyState : public State
 {
@@ -11,6 +14,8 @@ public:
   void enter() const override {}
   void exit() const override {}
   void act(float/* dt*/, flecs::world &/*ecs*/, flecs::entity /*entity*/) const override {}
+  const char *name() const override { return "AttackEnemyState"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 class MoveToEnemyState : public State
@@ -25,6 +30,8 @@ public:
       a.action = move_towards(pos, enemy_pos);
     });
   }
+  const char *name() const override { return "MoveToEnemyState"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 class FleeFromEnemyState : public State
@@ -35,11 +42,16 @@ public:
   void exit() const override {}
   void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
+    const Team *team = entity.get<Team>();
+    if (!team)
+      return;
     on_closest_enemy_pos(ecs, entity, [&](Action &a, const Position &pos, const Position &enemy_pos)
     {
-      a.action = inverse_move(move_towards(pos, enemy_pos));
+      a.action = least_threat_move(ecs, team->team, pos, inverse_move(move_towards(pos, enemy_pos)));
     });
   }
+  const char *name() const override { return "FleeFromEnemyState"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 class PatrolState : public State
@@ -49,19 +61,21 @@ public:
   PatrolState(float dist) : patrolDist(dist) {}
   void enter() const override {}
   void exit() const override {}
-  void act(float/* dt*/, flecs::world &, flecs::entity entity) const override
+  void act(float/* dt*/, flecs::world &ecs, flecs::entity entity) const override
   {
-    entity.set([&](const Position &pos, const PatrolPos &ppos, Action &a)
+    entity.set([&](const Position &pos, const PatrolPos &ppos, const Team &team, Action &a)
     {
       if (dist(pos, ppos) > patrolDist)
         a.action = move_towards(pos, ppos); // do a recovery walk
       else
       {
         // do a random walk
-        a.action = GetRandomValue(EA_MOVE_START, EA_MOVE_END - 1);
+        a.action = avoid_threat_move(ecs, team.team, pos, entity_rng(ecs, entity).range(EA_MOVE_START, EA_MOVE_END - 1));
       }
     });
   }
+  const char *name() const override { return "PatrolState"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 class NopState : public State
@@ -70,6 +84,8 @@ public:
   void enter() const override {}
   void exit() const override {}
   void act(float/* dt*/, flecs::world &, flecs::entity) const override {}
+  const char *name() const override { return "NopState"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 class EnemyAvailableTransition : public StateTransition
@@ -79,13 +95,14 @@ public:
   EnemyAvailableTransition(float in_dist) : triggerDist(in_dist) {}
   bool isAvailable(flecs::world &ecs, flecs::entity entity) const override
   {
-    static auto enemiesQuery = ecs.query<const Position, const Team>();
+    auto &enemiesQuery = cached_query<const Position, const Team>(ecs);
     bool enemiesFound = false;
+    const FieldOfView *fov = entity.get<FieldOfView>();
     entity.get([&](const Position &pos, const Team &t)
     {
       enemiesQuery.each([&](const Position &epos, const Team &et)
       {
-        if (t.team == et.team)
+        if (t.team == et.team || (fov && !fov->canSee(epos)))
           return;
         float curDist = dist(epos, pos);
         enemiesFound |= curDist <= triggerDist;
@@ -93,6 +110,8 @@ public:
     });
     return enemiesFound;
   }
+  const char *name() const override { return "EnemyAvailableTransition"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 class HitpointsLessThanTransition : public StateTransition
@@ -109,6 +128,8 @@ public:
     });
     return hitpointsThresholdReached;
   }
+  const char *name() const override { return "HitpointsLessThanTransition"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 class EnemyReachableTransition : public StateTransition
@@ -118,6 +139,8 @@ public:
   {
     return false;
   }
+  const char *name() const override { return "EnemyReachableTransition"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 class NegateTransition : public StateTransition
@@ -131,6 +154,12 @@ public:
   {
     return !transition->isAvailable(ecs, entity);
   }
+  const char *name() const override { return "NegateTransition"; }
+  void countMemory(AiMemoryStats &stats) const override
+  {
+    stats.add(name(), sizeof(*this));
+    transition->countMemory(stats);
+  }
 };
 
 class AndTransition : public StateTransition
@@ -149,6 +178,13 @@ public:
   {
     return lhs->isAvailable(ecs, entity) && rhs->isAvailable(ecs, entity);
   }
+  const char *name() const override { return "AndTransition"; }
+  void countMemory(AiMemoryStats &stats) const override
+  {
+    stats.add(name(), sizeof(*this));
+    lhs->countMemory(stats);
+    rhs->countMemory(stats);
+  }
 };
 
 
@@ -21,8 +21,19 @@ BehNode *sequence(const std::vector<BehNode*> &nodes);
 BehNode *selector(const std::vector<BehNode*> &nodes);
 
 BehNode *move_to_entity(flecs::entity entity, const char *bb_name);
-BehNode *is_low_hp(float thres);
+// reads hitpoints from a float slot, see SelfSensors
+BehNode *is_low_hp(flecs::entity entity, float thres, const char *bb_name);
 BehNode *find_enemy(flecs::entity entity, float dist, const char *bb_name);
 BehNode *flee(flecs::entity entity, const char *bb_name);
 BehNode *patrol(flecs::entity entity, float patrol_dist, const char *bb_name);
+// same leaves as coroutines keeping their state between turns, see behCoroutine.h
+BehNode *move_to_entity_co(flecs::entity entity, const char *bb_name);
+BehNode *flee_co(flecs::entity entity, const char *bb_name);
+BehNode *patrol_co(flecs::entity entity, float patrol_dist, const char *bb_name);
+// Re-evaluates node only when one of its input slots changed, otherwise returns the previous result.
+// Only for side effect free nodes whose result depends on nothing but those slots (conditions).
+BehNode *cached(BehNode *node, const BbSubscription &inputs);
 
+// registers "self_hp" (float) and "self_pos" (Position) slots
+void add_self_sensors(flecs::entity entity);
+void update_self_sensors(flecs::world &ecs);
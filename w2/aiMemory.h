@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+
+// Bytes held by AI structures (behaviour nodes, FSM states and transitions) by type name.
+// Every object adds itself together with the heap data it owns, owners pass the stats down
+// to the objects they own. Names are string literals, so they key the map by pointer.
+struct AiMemoryStats
+{
+  struct Entry
+  {
+    size_t count = 0;
+    size_t bytes = 0;
+  };
+  std::unordered_map<const char*, Entry> byType;
+  size_t total = 0;
+
+  void add(const char *type, size_t bytes)
+  {
+    Entry &entry = byType[type];
+    entry.count++;
+    entry.bytes += bytes;
+    total += bytes;
+  }
+};
@@ -0,0 +1,174 @@
+#include "aiProfiler.h"
+
+#ifdef AI_PROFILER
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ai_profiler
+{
+  struct Record
+  {
+    const char *type = nullptr;
+    std::string path;
+    uint64_t key = 0;
+    uint64_t calls = 0;
+    uint64_t results[APR_NUM] = {};
+    int64_t totalNs = 0;
+    int64_t selfNs = 0;
+  };
+
+  struct Frame
+  {
+    Record *rec = nullptr;
+    int64_t childNs = 0;
+  };
+
+  struct ThreadData
+  {
+    std::unordered_map<uint64_t, Record> records;
+    std::vector<Frame> stack;
+  };
+
+  // every thread gets its own data, registry owns it so that it survives thread exit
+  static std::mutex registryMutex;
+  static std::vector<std::unique_ptr<ThreadData>> registry;
+
+  static ThreadData &thread_data()
+  {
+    thread_local ThreadData *data = nullptr;
+    if (!data)
+    {
+      std::lock_guard<std::mutex> lock(registryMutex);
+      registry.emplace_back(std::make_unique<ThreadData>());
+      data = registry.back().get();
+    }
+    return *data;
+  }
+
+  static uint64_t hash_combine(uint64_t seed, uint64_t val)
+  {
+    return seed ^ (val + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+  }
+
+  Record *enter(const char *type, size_t idx, size_t sub_idx)
+  {
+    ThreadData &td = thread_data();
+    Record *parent = td.stack.empty() ? nullptr : td.stack.back().rec;
+    const uint64_t parentKey = parent ? parent->key : 0;
+    const uint64_t key = hash_combine(hash_combine(hash_combine(parentKey, reinterpret_cast<uintptr_t>(type)), idx), sub_idx);
+
+    auto [itf, inserted] = td.records.try_emplace(key);
+    Record &rec = itf->second;
+    if (inserted)
+    {
+      rec.type = type;
+      rec.key = key;
+      if (parent)
+      {
+        rec.path = parent->path + "/" + std::to_string(idx);
+        if (sub_idx != size_t(-1))
+          rec.path += "." + std::to_string(sub_idx);
+        rec.path += std::string(":") + type;
+      }
+      else
+        rec.path = type;
+    }
+    td.stack.push_back(Frame{&rec, 0});
+    return &rec;
+  }
+
+  void leave(Record *rec, int64_t total_ns, int result)
+  {
+    ThreadData &td = thread_data();
+    const Frame frame = td.stack.back();
+    td.stack.pop_back();
+
+    rec->calls++;
+    if (result >= 0 && result < APR_NUM)
+      rec->results[result]++;
+    rec->totalNs += total_ns;
+    rec->selfNs += total_ns - frame.childNs;
+    if (!td.stack.empty())
+      td.stack.back().childNs += total_ns;
+  }
+}
+
+void ai_profiler_reset()
+{
+  std::lock_guard<std::mutex> lock(ai_profiler::registryMutex);
+  for (auto &td : ai_profiler::registry)
+    td->records.clear();
+}
+
+static void print_record(FILE *out, const ai_profiler::Record &rec, const char *name)
+{
+  const double totalMs = double(rec.totalNs) * 1e-6;
+  const double selfMs = double(rec.selfNs) * 1e-6;
+  const double avgUs = rec.calls ? double(rec.totalNs) * 1e-3 / double(rec.calls) : 0.0;
+  fprintf(out, "%10.3f %10.3f %10llu %9.3f %9llu %9llu %9llu  %s\n", selfMs, totalMs,
+          static_cast<unsigned long long>(rec.calls), avgUs,
+          static_cast<unsigned long long>(rec.results[APR_SUCCESS]),
+          static_cast<unsigned long long>(rec.results[APR_FAIL]),
+          static_cast<unsigned long long>(rec.results[APR_RUNNING]), name);
+}
+
+void ai_profiler_report(FILE *out, size_t max_rows)
+{
+  using ai_profiler::Record;
+  std::unordered_map<uint64_t, Record> byPath;
+  std::unordered_map<std::string, Record> byType;
+  {
+    std::lock_guard<std::mutex> lock(ai_profiler::registryMutex);
+    for (const auto &td : ai_profiler::registry)
+      for (const auto &[key, rec] : td->records)
+      {
+        for (Record *dst : {&byPath[key], &byType[rec.type]})
+        {
+          dst->type = rec.type;
+          dst->path = rec.path;
+          dst->calls += rec.calls;
+          for (size_t i = 0; i < APR_NUM; ++i)
+            dst->results[i] += rec.results[i];
+          dst->totalNs += rec.totalNs;
+          dst->selfNs += rec.selfNs;
+        }
+      }
+  }
+
+  auto sorted = [](const auto &records)
+  {
+    std::vector<const Record*> res;
+    for (const auto &kv : records)
+      res.push_back(&kv.second);
+    std::sort(res.begin(), res.end(), [](const Record *lhs, const Record *rhs) { return lhs->selfNs > rhs->selfNs; });
+    return res;
+  };
+
+  // success/fail columns are taken/not taken for transitions
+  fprintf(out, "AI profile by node type\n");
+  fprintf(out, "   self ms   total ms      calls    avg us   success      fail   running  type\n");
+  for (const Record *rec : sorted(byType))
+    print_record(out, *rec, rec->type);
+
+  fprintf(out, "AI hot spots by tree position\n");
+  fprintf(out, "   self ms   total ms      calls    avg us   success      fail   running  position\n");
+  const std::vector<const Record*> hotSpots = sorted(byPath);
+  for (size_t i = 0; i < hotSpots.size() && i < max_rows; ++i)
+    print_record(out, *hotSpots[i], hotSpots[i]->path.c_str());
+}
+
+#else
+
+void ai_profiler_reset() {}
+
+void ai_profiler_report(FILE *out, size_t)
+{
+  fprintf(out, "AI profiler is disabled, rebuild with -Dai_profiler=ON\n");
+}
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Profiler for AI decision code (behaviour tree nodes, FSM states and transitions).
+// Gathers invocations, results and inclusive/self time per node type and per tree position.
+// Instrumentation is compiled in only with AI_PROFILER defined (cmake -Dai_profiler=ON),
+// otherwise AiProfileScope is an empty object and costs nothing.
+
+// Result slots used by the profiler. Behaviour nodes report BehResult values,
+// transitions report APR_TAKEN/APR_NOT_TAKEN, states report nothing.
+enum AiProfileResult
+{
+  APR_SUCCESS = 0,
+  APR_FAIL,
+  APR_RUNNING,
+  APR_NUM,
+
+  APR_TAKEN = APR_SUCCESS,
+  APR_NOT_TAKEN = APR_FAIL
+};
+
+void ai_profiler_reset();
+void ai_profiler_report(FILE *out, size_t max_rows);
+
+#ifdef AI_PROFILER
+
+namespace ai_profiler
+{
+  struct Record;
+  Record *enter(const char *type, size_t idx, size_t sub_idx);
+  void leave(Record *rec, int64_t total_ns, int result);
+}
+
+class AiProfileScope
+{
+  ai_profiler::Record *record = nullptr;
+  std::chrono::steady_clock::time_point start;
+  int res = -1;
+public:
+  // idx/sub_idx describe position of the object within its parent (child index, state/transition index)
+  template<typename T>
+  AiProfileScope(const T *obj, size_t idx, size_t sub_idx = size_t(-1))
+    : record(ai_profiler::enter(obj->name(), idx, sub_idx)), start(std::chrono::steady_clock::now())
+  {}
+  ~AiProfileScope()
+  {
+    const auto total = std::chrono::steady_clock::now() - start;
+    ai_profiler::leave(record, std::chrono::duration_cast<std::chrono::nanoseconds>(total).count(), res);
+  }
+
+  AiProfileScope(const AiProfileScope &) = delete;
+  AiProfileScope &operator=(const AiProfileScope &) = delete;
+
+  template<typename ResType>
+  ResType result(ResType r)
+  {
+    res = int(r);
+    return r;
+  }
+};
+
+#else
+
+class AiProfileScope
+{
+public:
+  template<typename T>
+  AiProfileScope(const T *, size_t, size_t = size_t(-1)) {}
+
+  template<typename ResType>
+  ResType result(ResType r) { return r; }
+};
+
+#endif
@@ -2,7 +2,9 @@
 #include <flecs.h>
 #include "blackboard.h"
 #include <float.h>
+#include <vector>
 #include "math.h"
+#include "queryCache.h"
 
 template<typename T, typename U>
 inline int move_towards(const T &from, const U &to)
@@ -14,6 +16,19 @@ inline int move_towards(const T &from, const U &to)
   return deltaY < 0 ? EA_MOVE_UP : EA_MOVE_DOWN;
 }
 
+inline Position move_pos(Position pos, int action)
+{
+  if (action == EA_MOVE_LEFT)
+    pos.x--;
+  else if (action == EA_MOVE_RIGHT)
+    pos.x++;
+  else if (action == EA_MOVE_UP)
+    pos.y--;
+  else if (action == EA_MOVE_DOWN)
+    pos.y++;
+  return pos;
+}
+
 inline int inverse_move(int move)
 {
   return move == EA_MOVE_LEFT ? EA_MOVE_RIGHT :
@@ -25,7 +40,7 @@ inline int inverse_move(int move)
 template<typename Callable>
 inline void on_closest_enemy_pos(flecs::world &ecs, flecs::entity entity, Callable c)
 {
-  static auto enemiesQuery = ecs.query<const Position, const Team>();
+  auto &enemiesQuery = cached_query<const Position, const Team>(ecs);
   entity.set([&](const Position &pos, const Team &t, Action &a)
   {
     flecs::entity closestEnemy;
@@ -0,0 +1,231 @@
+#include "batchRunner.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <float.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <flecs.h>
+#include "ecsTypes.h"
+#include "roguelike.h"
+#include "aiArchetypes.h"
+#include "mcts.h"
+#include "aiUtils.h"
+#include "math.h"
+#include "queryCache.h"
+
+static const float monster_hitpoints[] = {50.f, 100.f, 150.f};
+static const float monster_damage[] = {10.f, 20.f, 30.f};
+static constexpr int monster_count = 4;
+
+enum MatchOutcome : uint8_t
+{
+  MO_WIN = 0, // all monsters are dead
+  MO_LOSS,    // player is dead
+  MO_DRAW,    // turn limit reached
+  MO_NUM
+};
+
+static const char *outcome_names[MO_NUM] = {"win", "loss", "draw"};
+
+struct MatchSetup
+{
+  uint8_t ai = AI_NONE;
+  float hitpoints = 0.f;
+  float damage = 0.f;
+};
+
+struct MatchResult
+{
+  MatchOutcome outcome = MO_DRAW;
+  int turns = 0;
+  float playerHitpoints = 0.f;
+  int monstersLeft = 0;
+};
+
+static std::vector<MatchSetup> make_setups()
+{
+  std::vector<MatchSetup> setups;
+  for (uint8_t ai = AI_NONE + 1; ai < AI_NUM; ++ai)
+    for (float hp : monster_hitpoints)
+      for (float dmg : monster_damage)
+        setups.push_back(MatchSetup{ai, hp, dmg});
+  return setups;
+}
+
+static std::string make_scenario(const MatchSetup &setup)
+{
+  char text[512];
+  snprintf(text, sizeof(text),
+    "type monster hp=%g damage=%g team=1 ai=%s\n"
+    "type swordsman player=1 pickup=1 hp=100 damage=50 team=0 actions=2\n"
+    "type heal heal=50\n"
+    "type powerup power=10\n"
+    "spawn swordsman 1 0 0\n"
+    "spawn monster %d -8 -8 8 8\n"
+    "spawn heal 3 -8 -8 8 8\n"
+    "spawn powerup 3 -8 -8 8 8\n",
+    double(setup.hitpoints), double(setup.damage), ai_archetype_name(setup.ai), monster_count);
+  return text;
+}
+
+// Picks the player move, returns false when the match is decided
+static bool play_player_turn(flecs::world &ecs, MatchResult &result)
+{
+  auto &playerQuery = cached_query<const IsPlayer, const Position, const Hitpoints, const Team, Action>(ecs);
+  auto &actorsQuery = cached_query<const Position, const Team, const Hitpoints>(ecs);
+  auto &healsQuery = cached_query<const Position, const HealAmount>(ecs);
+
+  bool playerAlive = false;
+  playerQuery.each([&](const IsPlayer, const Position &pos, const Hitpoints &hp, const Team &team, Action &a)
+  {
+    playerAlive = true;
+    result.playerHitpoints = hp.hitpoints;
+    result.monstersLeft = 0;
+    Position target = pos;
+    float closestDist = FLT_MAX;
+    actorsQuery.each([&](const Position &epos, const Team &et, const Hitpoints &)
+    {
+      if (et.team == team.team)
+        return;
+      result.monstersLeft++;
+      const float curDist = dist(epos, pos);
+      if (curDist < closestDist)
+      {
+        closestDist = curDist;
+        target = epos;
+      }
+    });
+    if (hp.hitpoints < 50.f)
+    {
+      closestDist = FLT_MAX;
+      healsQuery.each([&](const Position &hpos, const HealAmount &)
+      {
+        const float curDist = dist(hpos, pos);
+        if (curDist < closestDist)
+        {
+          closestDist = curDist;
+          target = hpos;
+        }
+      });
+    }
+    a.action = target == pos ? EA_NOP : move_towards(pos, target);
+  });
+
+  if (!playerAlive)
+  {
+    result.outcome = MO_LOSS;
+    result.playerHitpoints = 0.f;
+    return false;
+  }
+  if (result.monstersLeft == 0)
+  {
+    result.outcome = MO_WIN;
+    return false;
+  }
+  return true;
+}
+
+static MatchResult play_match(const std::string &scenario, uint64_t seed, int max_turns)
+{
+  MatchResult result;
+  flecs::world ecs;
+  ecs.set(WorldSeed{seed});
+  // matches are already spread over all cores
+  ecs.set(MctsSettings{1});
+  if (!init_roguelike_from_string(ecs, true, scenario.c_str(), "batch scenario"))
+    return result;
+  for (; result.turns < max_turns; ++result.turns)
+  {
+    if (!play_player_turn(ecs, result))
+      return result;
+    process_turn(ecs);
+  }
+  result.outcome = MO_DRAW;
+  return result;
+}
+
+// Rows are written as soon as a match finishes, so a long run can be inspected or cut short
+class ResultSink
+{
+  std::mutex mutex;
+  FILE *file = nullptr;
+  std::vector<int> counts;
+public:
+  ResultSink(FILE *f, size_t num_setups) : file(f), counts(num_setups * MO_NUM, 0) {}
+
+  void add(size_t match, size_t setup_idx, const MatchSetup &setup, uint64_t seed, const MatchResult &res)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    counts[setup_idx * MO_NUM + res.outcome]++;
+    fprintf(file, "%zu,%s,%g,%g,%llu,%s,%d,%g,%d\n", match, ai_archetype_name(setup.ai),
+      double(setup.hitpoints), double(setup.damage), static_cast<unsigned long long>(seed),
+      outcome_names[res.outcome], res.turns, double(res.playerHitpoints), res.monstersLeft);
+  }
+
+  int count(size_t setup_idx, MatchOutcome outcome) const { return counts[setup_idx * MO_NUM + outcome]; }
+};
+
+int run_batch(const BatchConfig &config)
+{
+  const std::vector<MatchSetup> setups = make_setups();
+  std::vector<std::string> scenarios;
+  for (const MatchSetup &setup : setups)
+    scenarios.push_back(make_scenario(setup));
+  const size_t numMatches = setups.size() * size_t(std::max(config.matchesPerSetup, 0));
+
+  FILE *file = fopen(config.outPath, "wb");
+  if (!file)
+  {
+    fprintf(stderr, "cannot open '%s'\n", config.outPath);
+    return 1;
+  }
+  fprintf(file, "match,ai,monster_hp,monster_damage,seed,outcome,turns,player_hp,monsters_left\n");
+  ResultSink sink(file, setups.size());
+
+  // flecs keeps component ids of C++ types in process-wide statics. A world created here registers
+  // every component and singleton type (see init_world) before workers start creating their own
+  {
+    flecs::world ecs;
+    if (!init_roguelike_from_string(ecs, true, scenarios.empty() ? "" : scenarios[0].c_str(), "batch scenario"))
+      return 1;
+  }
+
+  const int numThreads = config.threads > 0 ? config.threads : int(std::max(std::thread::hardware_concurrency(), 1u));
+  std::atomic<size_t> nextMatch{0};
+  auto worker = [&]()
+  {
+    for (size_t match; (match = nextMatch.fetch_add(1, std::memory_order_relaxed)) < numMatches;)
+    {
+      const size_t setupIdx = match % setups.size();
+      const uint64_t seed = config.seed + match / setups.size();
+      const MatchResult res = play_match(scenarios[setupIdx], seed, config.maxTurns);
+      sink.add(match, setupIdx, setups[setupIdx], seed, res);
+    }
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; ++i)
+    threads.emplace_back(worker);
+  for (std::thread &t : threads)
+    t.join();
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  fclose(file);
+
+  printf("%zu matches on %d threads in %.2f s (%.1f matches/s), results in %s\n",
+    numMatches, numThreads, seconds, seconds > 0.0 ? double(numMatches) / seconds : 0.0, config.outPath);
+  printf("%-10s %6s %6s %8s %8s %8s\n", "ai", "hp", "damage", "win", "loss", "draw");
+  for (size_t i = 0; i < setups.size(); ++i)
+  {
+    const double total = std::max(config.matchesPerSetup, 1);
+    printf("%-10s %6g %6g %7.1f%% %7.1f%% %7.1f%%\n", ai_archetype_name(setups[i].ai),
+      double(setups[i].hitpoints), double(setups[i].damage),
+      100.0 * sink.count(i, MO_WIN) / total, 100.0 * sink.count(i, MO_LOSS) / total,
+      100.0 * sink.count(i, MO_DRAW) / total);
+  }
+  return 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+// Runs many independent headless matches for AI tuning. Every match gets its own world, so they
+// are spread over a thread pool. The player is driven by a scripted policy (heal when hurt,
+// otherwise go for the closest enemy) against monsters of one AI archetype. Setups are the
+// cross product of all archetypes and a small grid of monster hitpoints/damage, every setup is
+// played matches_per_setup times with different seeds. Results are streamed to a CSV file as
+// matches finish, win rates per setup are printed at the end.
+struct BatchConfig
+{
+  int matchesPerSetup = 100;
+  int threads = 0; // 0 picks hardware concurrency
+  int maxTurns = 1000;
+  uint64_t seed = 1;
+  const char *outPath = "batch.csv";
+};
+
+int run_batch(const BatchConfig &config);
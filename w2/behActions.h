@@ -0,0 +1,108 @@
+#pragma once
+#include <cfloat>
+#include <flecs.h>
+#include "behaviourTree.h"
+#include "ecsTypes.h"
+#include "aiUtils.h"
+#include "math.h"
+#include "rng.h"
+#include "influenceMap.h"
+#include "fov.h"
+#include "queryCache.h"
+
+// Leaf bodies shared by the runtime built (behLibrary) and the static (staticBehLibrary) trees,
+// blackboard values are passed in and out explicitly
+
+inline BehResult move_to_entity_action(flecs::entity entity, flecs::entity target)
+{
+  BehResult res = BEH_RUNNING;
+  entity.set([&](Action &a, const Position &pos)
+  {
+    if (!target.is_alive())
+    {
+      res = BEH_FAIL;
+      return;
+    }
+    target.get([&](const Position &target_pos)
+    {
+      if (pos != target_pos)
+      {
+        a.action = move_towards(pos, target_pos);
+        res = BEH_RUNNING;
+      }
+      else
+        res = BEH_SUCCESS;
+    });
+  });
+  return res;
+}
+
+inline BehResult is_low_hp_check(flecs::entity entity, float threshold)
+{
+  BehResult res = BEH_SUCCESS;
+  entity.get([&](const Hitpoints &hp)
+  {
+    res = hp.hitpoints < threshold ? BEH_SUCCESS : BEH_FAIL;
+  });
+  return res;
+}
+
+// found is only written on success
+inline BehResult find_enemy_action(flecs::world &ecs, flecs::entity entity, float distance, flecs::entity &found)
+{
+  BehResult res = BEH_FAIL;
+  auto &enemiesQuery = cached_query<const Position, const Team>(ecs);
+  const FieldOfView *fov = entity.get<FieldOfView>();
+  entity.set([&](const Position &pos, const Team &t)
+  {
+    flecs::entity closestEnemy;
+    float closestDist = FLT_MAX;
+    enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
+    {
+      if (t.team == et.team || (fov && !fov->canSee(epos)))
+        return;
+      float curDist = dist(epos, pos);
+      if (curDist < closestDist)
+      {
+        closestDist = curDist;
+        closestEnemy = enemy;
+      }
+    });
+    if (ecs.is_valid(closestEnemy) && closestDist <= distance)
+    {
+      found = closestEnemy;
+      res = BEH_SUCCESS;
+    }
+  });
+  return res;
+}
+
+inline BehResult flee_action(flecs::world &ecs, flecs::entity entity, flecs::entity target)
+{
+  BehResult res = BEH_RUNNING;
+  entity.set([&](Action &a, const Position &pos, const Team &team)
+  {
+    if (!target.is_alive())
+    {
+      res = BEH_FAIL;
+      return;
+    }
+    target.get([&](const Position &target_pos)
+    {
+      a.action = least_threat_move(ecs, team.team, pos, inverse_move(move_towards(pos, target_pos)));
+    });
+  });
+  return res;
+}
+
+inline BehResult patrol_action(flecs::world &ecs, flecs::entity entity, const Position &patrol_pos, float patrol_dist)
+{
+  entity.set([&](Action &a, const Position &pos, const Team &team)
+  {
+    if (dist(pos, patrol_pos) > patrol_dist)
+      a.action = move_towards(pos, patrol_pos);
+    else // do a random walk
+      a.action = avoid_threat_move(ecs, team.team, pos, entity_rng(ecs, entity).range(EA_MOVE_START, EA_MOVE_END - 1));
+  });
+  return BEH_RUNNING;
+}
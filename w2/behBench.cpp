@@ -0,0 +1,101 @@
+#include "behBench.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <flecs.h>
+#include "ecsTypes.h"
+#include "roguelike.h"
+#include "scenario.h"
+#include "aiArchetypes.h"
+#include "aiLibrary.h"
+#include "behaviourTree.h"
+#include "staticBehLibrary.h"
+#include "influenceMap.h"
+#include "fov.h"
+#include "queryCache.h"
+
+static void collect_actions(flecs::world &ecs, std::vector<int> &actions)
+{
+  auto &actionsQuery = cached_query<Action, const AiArchetype>(ecs);
+  actions.clear();
+  actionsQuery.each([&](Action &a, const AiArchetype &)
+  {
+    actions.push_back(a.action);
+    a.action = EA_NOP;
+  });
+}
+
+int run_bt_benchmark(int num_agents, int num_ticks)
+{
+  flecs::world ecs;
+  ecs.set(WorldSeed{1});
+  if (!init_roguelike(ecs, true))
+    return 1;
+  // a quarter of the minotaurs is hurt, so the flee branch gets exercised too
+  const int radius = int(sqrtf(float(num_agents))) * 2;
+  char region[64];
+  snprintf(region, sizeof(region), " %d %d %d %d\n", -radius, -radius, radius, radius);
+  const std::string text =
+    "type minotaur hp=100 damage=20 team=1 ai=minotaur\n"
+    "type wounded hp=40 damage=20 team=1 ai=minotaur\n"
+    "type target hp=100 damage=10 team=0\n"
+    "spawn minotaur " + std::to_string(num_agents - num_agents / 4) + region +
+    "spawn wounded " + std::to_string(num_agents / 4) + region +
+    "spawn target " + std::to_string(num_agents / 4) + region;
+  if (!load_scenario_from_string(ecs, text.c_str(), "bt benchmark"))
+    return 1;
+  update_influence_maps(ecs);
+  update_fields_of_view(ecs);
+  update_self_sensors(ecs);
+
+  auto &dynamicQuery = cached_query<BehaviourTree, Blackboard>(ecs);
+  auto &staticQuery = cached_query<static_bt::MinotaurBt>(ecs);
+  // adding the static tree moves the entity to another table, not allowed while iterating
+  ecs.defer([&]
+  {
+    dynamicQuery.each([&](flecs::entity e, BehaviourTree &, Blackboard &)
+    {
+      static_bt::MinotaurBt bt;
+      bt.init(e);
+      e.set(bt);
+    });
+  });
+
+  // actions aren't applied, so every tick sees the same world and both trees have to agree
+  std::vector<int> dynamicActions;
+  std::vector<int> staticActions;
+  double dynamicTime = 0.0;
+  double staticTime = 0.0;
+  int mismatches = 0;
+  int agents = 0;
+  for (int tick = 0; tick < num_ticks; ++tick)
+  {
+    auto start = std::chrono::steady_clock::now();
+    dynamicQuery.each([&](flecs::entity e, BehaviourTree &bt, Blackboard &bb)
+    {
+      bt.update(ecs, e, bb);
+    });
+    dynamicTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    collect_actions(ecs, dynamicActions);
+
+    start = std::chrono::steady_clock::now();
+    staticQuery.each([&](flecs::entity e, static_bt::MinotaurBt &bt)
+    {
+      bt.update(ecs, e);
+    });
+    staticTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    collect_actions(ecs, staticActions);
+
+    agents = int(dynamicActions.size());
+    mismatches += dynamicActions != staticActions;
+  }
+
+  const double updates = double(agents) * double(num_ticks);
+  printf("%d agents, %d ticks\n", agents, num_ticks);
+  printf("runtime tree: %.1f ns/update\n", dynamicTime / updates * 1e9);
+  printf("static tree:  %.1f ns/update (%.2fx)\n", staticTime / updates * 1e9, dynamicTime / staticTime);
+  printf("%d ticks with different actions\n", mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Runs the minotaur behaviour as a runtime built tree and as static_bt::MinotaurBt over the same
+// headless world, prints update times and checks that both trees chose the same actions
+int run_bt_benchmark(int num_agents, int num_ticks);
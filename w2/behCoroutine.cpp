@@ -0,0 +1,89 @@
+#include "behCoroutine.h"
+#include <new>
+#include "ecsTypes.h"
+
+CoroutineFramePool::~CoroutineFramePool()
+{
+  for (FreeFrame *&list : freeLists)
+    while (list)
+    {
+      FreeFrame *next = list->next;
+      ::operator delete(list);
+      list = next;
+    }
+}
+
+void *CoroutineFramePool::allocate(size_t size)
+{
+  const size_t sizeClass = (size + granularity - 1) / granularity;
+  if (sizeClass >= num_classes)
+  {
+    liveBytes += size;
+    return ::operator new(size);
+  }
+  liveBytes += sizeClass * granularity;
+  if (FreeFrame *frame = freeLists[sizeClass])
+  {
+    freeLists[sizeClass] = frame->next;
+    freeBytes -= sizeClass * granularity;
+    return frame;
+  }
+  systemAllocs++;
+  return ::operator new(sizeClass * granularity);
+}
+
+void CoroutineFramePool::deallocate(void *ptr, size_t size)
+{
+  const size_t sizeClass = (size + granularity - 1) / granularity;
+  if (sizeClass >= num_classes)
+  {
+    liveBytes -= size;
+    ::operator delete(ptr);
+    return;
+  }
+  liveBytes -= sizeClass * granularity;
+  freeBytes += sizeClass * granularity;
+  FreeFrame *frame = static_cast<FreeFrame*>(ptr);
+  frame->next = freeLists[sizeClass];
+  freeLists[sizeClass] = frame;
+}
+
+CoroutineFramePool &coroutine_frame_pool()
+{
+  thread_local CoroutineFramePool pool;
+  return pool;
+}
+
+struct CoroutineNode : public BehNode
+{
+  const char *nodeName;
+  BehTaskFactory factory;
+  BehContext ctx;
+  BehTask task;
+  uint64_t lastTick = 0;
+
+  CoroutineNode(const char *name, BehTaskFactory in_factory) : nodeName(name), factory(std::move(in_factory)) {}
+
+  BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
+  {
+    // a planning tick skipped means a parent stopped visiting the node, start over then
+    const PlanTickCounter *counter = ecs.get<PlanTickCounter>();
+    const uint64_t tick = counter ? counter->tick : 0;
+    ctx = BehContext{&ecs, entity, &bb};
+    if (task.finished() || tick > lastTick + 1)
+    {
+      task = BehTask(); // old frame goes back to the pool first, so the new one reuses it
+      task = factory(ctx);
+    }
+    lastTick = tick;
+    return task.resume();
+  }
+  const char *name() const override { return nodeName; }
+  // the frame is accounted by the pool, its size isn't known here
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
+};
+
+BehNode *coroutine_node(const char *name, BehTaskFactory factory)
+{
+  return new CoroutineNode(name, std::move(factory));
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <flecs.h>
+#include "behaviourTree.h"
+
+// Free lists of coroutine frames by 64 byte size classes. Frames are never given back to the system,
+// so once behaviours have run for a turn or two, restarting them doesn't allocate. One pool per thread.
+class CoroutineFramePool
+{
+  static constexpr size_t granularity = 64;
+  static constexpr size_t num_classes = 16; // larger frames go straight to operator new
+
+  struct FreeFrame
+  {
+    FreeFrame *next;
+  };
+  std::array<FreeFrame*, num_classes> freeLists = {};
+  uint64_t systemAllocs = 0;
+  size_t liveBytes = 0;
+  size_t freeBytes = 0;
+public:
+  CoroutineFramePool() = default;
+  CoroutineFramePool(const CoroutineFramePool &) = delete;
+  CoroutineFramePool &operator=(const CoroutineFramePool &) = delete;
+  ~CoroutineFramePool();
+
+  void *allocate(size_t size);
+  void deallocate(void *ptr, size_t size);
+  uint64_t getSystemAllocs() const { return systemAllocs; }
+  // frames currently used by coroutines and frames waiting in the free lists
+  size_t getLiveBytes() const { return liveBytes; }
+  size_t getFreeBytes() const { return freeBytes; }
+};
+
+CoroutineFramePool &coroutine_frame_pool();
+
+// What a behaviour coroutine sees on every resume. The node refreshes it before resuming,
+// components may have moved between turns, so the coroutine must not cache pointers from it.
+struct BehContext
+{
+  flecs::world *ecs = nullptr;
+  flecs::entity entity;
+  Blackboard *bb = nullptr;
+};
+
+// Behaviour written as a coroutine: co_yield BEH_RUNNING ends the turn and keeps all locals
+// until the next one, co_return BEH_SUCCESS/BEH_FAIL finishes it.
+class BehTask
+{
+public:
+  struct promise_type
+  {
+    BehResult result = BEH_RUNNING;
+
+    BehTask get_return_object() { return BehTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(BehResult res) noexcept
+    {
+      result = res;
+      return {};
+    }
+    void return_value(BehResult res) noexcept { result = res; }
+    void unhandled_exception() { std::terminate(); }
+
+    static void *operator new(size_t size) { return coroutine_frame_pool().allocate(size); }
+    static void operator delete(void *ptr, size_t size) { coroutine_frame_pool().deallocate(ptr, size); }
+  };
+
+  BehTask() = default;
+  BehTask(const BehTask &) = delete;
+  BehTask(BehTask &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+  BehTask &operator=(const BehTask &) = delete;
+  BehTask &operator=(BehTask &&other) noexcept
+  {
+    if (this != &other)
+    {
+      if (handle)
+        handle.destroy();
+      handle = other.handle;
+      other.handle = nullptr;
+    }
+    return *this;
+  }
+  ~BehTask()
+  {
+    if (handle)
+      handle.destroy();
+  }
+
+  bool finished() const { return !handle || handle.done(); }
+  // runs the coroutine up to its next co_yield or co_return
+  BehResult resume()
+  {
+    handle.resume();
+    return handle.promise().result;
+  }
+
+private:
+  explicit BehTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+  std::coroutine_handle<promise_type> handle;
+};
+
+using BehTaskFactory = std::function<BehTask(const BehContext &ctx)>;
+
+// Resumes its coroutine once per update. A new coroutine is started after the previous one finished
+// or when the node wasn't updated on the previous planning tick (its branch was abandoned meanwhile).
+BehNode *coroutine_node(const char *name, BehTaskFactory factory);
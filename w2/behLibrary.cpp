@@ -1,9 +1,10 @@
 #include "aiLibrary.h"
 #include "ecsTypes.h"
 #include "aiUtils.h"
-#include "math.h"
-#include "raylib.h"
 #include "blackboard.h"
+#include "behActions.h"
+#include "behCoroutine.h"
+#include "queryCache.h"
 
 struct CompoundNode : public BehNode
 {
@@ -21,34 +22,43 @@ struct CompoundNode : public BehNode
     nodes.push_back(node);
     return *this;
   }
+
+  void countMemory(AiMemoryStats &stats) const override
+  {
+    stats.add(name(), sizeof(*this) + nodes.capacity() * sizeof(BehNode*));
+    for (const BehNode *node : nodes)
+      node->countMemory(stats);
+  }
 };
 
 struct Sequence : public CompoundNode
 {
   BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
-    for (BehNode *node : nodes)
+    for (size_t i = 0; i < nodes.size(); ++i)
     {
-      BehResult res = node->update(ecs, entity, bb);
+      BehResult res = update_node(nodes[i], i, ecs, entity, bb);
       if (res != BEH_SUCCESS)
         return res;
     }
     return BEH_SUCCESS;
   }
+  const char *name() const override { return "Sequence"; }
 };
 
 struct Selector : public CompoundNode
 {
   BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
-    for (BehNode *node : nodes)
+    for (size_t i = 0; i < nodes.size(); ++i)
     {
-      BehResult res = node->update(ecs, entity, bb);
+      BehResult res = update_node(nodes[i], i, ecs, entity, bb);
       if (res != BEH_FAIL)
         return res;
     }
     return BEH_FAIL;
   }
+  const char *name() const override { return "Selector"; }
 };
 
 struct MoveToEntity : public BehNode
@@ -61,44 +71,27 @@ struct MoveToEntity : public BehNode
 
   BehResult update(flecs::world &, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_RUNNING;
-    entity.set([&](Action &a, const Position &pos)
-    {
-      flecs::entity targetEntity = bb.get<flecs::entity>(entityBb);
-      if (!targetEntity.is_alive())
-      {
-        res = BEH_FAIL;
-        return;
-      }
-      targetEntity.get([&](const Position &target_pos)
-      {
-        if (pos != target_pos)
-        {
-          a.action = move_towards(pos, target_pos);
-          res = BEH_RUNNING;
-        }
-        else
-          res = BEH_SUCCESS;
-      });
-    });
-    return res;
+    return move_to_entity_action(entity, bb.get<flecs::entity>(entityBb));
   }
+  const char *name() const override { return "MoveToEntity"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 struct IsLowHp : public BehNode
 {
+  size_t hitpointsBb = size_t(-1);
   float threshold = 0.f;
-  IsLowHp(float thres) : threshold(thres) {}
+  IsLowHp(flecs::entity entity, float thres, const char *bb_name) : threshold(thres)
+  {
+    hitpointsBb = reg_entity_blackboard_var<float>(entity, bb_name);
+  }
 
-  BehResult update(flecs::world &, flecs::entity entity, Blackboard &) override
+  BehResult update(flecs::world &, flecs::entity, Blackboard &bb) override
   {
-    BehResult res = BEH_SUCCESS;
-    entity.get([&](const Hitpoints &hp)
-    {
-      res = hp.hitpoints < threshold ? BEH_SUCCESS : BEH_FAIL;
-    });
-    return res;
+    return bb.get<float>(hitpointsBb) < threshold ? BEH_SUCCESS : BEH_FAIL;
   }
+  const char *name() const override { return "IsLowHp"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 struct FindEnemy : public BehNode
@@ -111,33 +104,14 @@ struct FindEnemy : public BehNode
   }
   BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_FAIL;
-    static auto enemiesQuery = ecs.query<const Position, const Team>();
-    entity.set([&](const Position &pos, const Team &t)
-    {
-      flecs::entity closestEnemy;
-      float closestDist = FLT_MAX;
-      Position closestPos;
-      enemiesQuery.each([&](flecs::entity enemy, const Position &epos, const Team &et)
-      {
-        if (t.team == et.team)
-          return;
-        float curDist = dist(epos, pos);
-        if (curDist < closestDist)
-        {
-          closestDist = curDist;
-          closestPos = epos;
-          closestEnemy = enemy;
-        }
-      });
-      if (ecs.is_valid(closestEnemy) && closestDist <= distance)
-      {
-        bb.set<flecs::entity>(entityBb, closestEnemy);
-        res = BEH_SUCCESS;
-      }
-    });
+    flecs::entity enemy;
+    const BehResult res = find_enemy_action(ecs, entity, distance, enemy);
+    if (res == BEH_SUCCESS)
+      bb.set<flecs::entity>(entityBb, enemy);
     return res;
   }
+  const char *name() const override { return "FindEnemy"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 struct Flee : public BehNode
@@ -148,24 +122,12 @@ struct Flee : public BehNode
     entityBb = reg_entity_blackboard_var<flecs::entity>(entity, bb_name);
   }
 
-  BehResult update(flecs::world &, flecs::entity entity, Blackboard &bb) override
+  BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_RUNNING;
-    entity.set([&](Action &a, const Position &pos)
-    {
-      flecs::entity targetEntity = bb.get<flecs::entity>(entityBb);
-      if (!targetEntity.is_alive())
-      {
-        res = BEH_FAIL;
-        return;
-      }
-      targetEntity.get([&](const Position &target_pos)
-      {
-        a.action = inverse_move(move_towards(pos, target_pos));
-      });
-    });
-    return res;
+    return flee_action(ecs, entity, bb.get<flecs::entity>(entityBb));
   }
+  const char *name() const override { return "Flee"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
 };
 
 struct Patrol : public BehNode
@@ -182,18 +144,33 @@ struct Patrol : public BehNode
     });
   }
 
-  BehResult update(flecs::world &, flecs::entity entity, Blackboard &bb) override
+  BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
   {
-    BehResult res = BEH_RUNNING;
-    entity.set([&](Action &a, const Position &pos)
-    {
-      Position patrolPos = bb.get<Position>(pposBb);
-      if (dist(pos, patrolPos) > patrolDist)
-        a.action = move_towards(pos, patrolPos);
-      else
-        a.action = GetRandomValue(EA_MOVE_START, EA_MOVE_END - 1); // do a random walk
-    });
-    return res;
+    return patrol_action(ecs, entity, bb.get<Position>(pposBb), patrolDist);
+  }
+  const char *name() const override { return "Patrol"; }
+  void countMemory(AiMemoryStats &stats) const override { stats.add(name(), sizeof(*this)); }
+};
+
+struct Cached : public BehNode
+{
+  BehNode *node = nullptr; // we own it
+  BbSubscription inputs;
+  BehResult lastResult = BEH_FAIL;
+  Cached(BehNode *in_node, const BbSubscription &in_inputs) : node(in_node), inputs(in_inputs) {}
+  ~Cached() override { delete node; }
+
+  BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) override
+  {
+    if (inputs.poll(bb))
+      lastResult = update_node(node, 0, ecs, entity, bb);
+    return lastResult;
+  }
+  const char *name() const override { return "Cached"; }
+  void countMemory(AiMemoryStats &stats) const override
+  {
+    stats.add(name(), sizeof(*this) + inputs.heapBytes());
+    node->countMemory(stats);
   }
 };
 
@@ -219,9 +196,9 @@ BehNode *move_to_entity(flecs::entity entity, const char *bb_name)
   return new MoveToEntity(entity, bb_name);
 }
 
-BehNode *is_low_hp(float thres)
+BehNode *is_low_hp(flecs::entity entity, float thres, const char *bb_name)
 {
-  return new IsLowHp(thres);
+  return new IsLowHp(entity, thres, bb_name);
 }
 
 BehNode *find_enemy(flecs::entity entity, float dist, const char *bb_name)
@@ -239,3 +216,104 @@ BehNode *patrol(flecs::entity entity, float patrol_dist, const char *bb_name)
   return new Patrol(entity, patrol_dist, bb_name);
 }
 
+BehNode *cached(BehNode *node, const BbSubscription &inputs)
+{
+  return new Cached(node, inputs);
+}
+
+void add_self_sensors(flecs::entity entity)
+{
+  entity.set(SelfSensors{reg_entity_blackboard_var<float>(entity, "self_hp"),
+                         reg_entity_blackboard_var<Position>(entity, "self_pos")});
+}
+
+void update_self_sensors(flecs::world &ecs)
+{
+  auto &sensorsQuery = cached_query<struct AwakeSensorsQuery>(ecs, [&]
+  {
+    return ecs.query_builder<Blackboard, const SelfSensors, const Hitpoints, const Position>()
+      .term<Dormant>().not_()
+      .build();
+  });
+  sensorsQuery.each([&](Blackboard &bb, const SelfSensors &sensors, const Hitpoints &hp, const Position &pos)
+  {
+    bb.set<float>(sensors.hitpointsBb, hp.hitpoints);
+    bb.set<Position>(sensors.positionBb, pos);
+  });
+}
+
+// Coroutine versions of the long running leaves: the slot value is read when the behaviour starts and
+// re-read only when the slot version moves, everything else stays in the frame between turns.
+static BehTask move_to_entity_task(const BehContext &ctx, size_t entity_bb)
+{
+  uint32_t version = ctx.bb->getVersion<flecs::entity>(entity_bb);
+  flecs::entity target = ctx.bb->get<flecs::entity>(entity_bb);
+  for (;;)
+  {
+    const BehResult res = move_to_entity_action(ctx.entity, target);
+    if (res != BEH_RUNNING)
+      co_return res;
+    co_yield BEH_RUNNING;
+    if (ctx.bb->getVersion<flecs::entity>(entity_bb) != version)
+    {
+      version = ctx.bb->getVersion<flecs::entity>(entity_bb);
+      target = ctx.bb->get<flecs::entity>(entity_bb);
+    }
+  }
+}
+
+static BehTask flee_task(const BehContext &ctx, size_t entity_bb)
+{
+  uint32_t version = ctx.bb->getVersion<flecs::entity>(entity_bb);
+  flecs::entity target = ctx.bb->get<flecs::entity>(entity_bb);
+  for (;;)
+  {
+    const BehResult res = flee_action(*ctx.ecs, ctx.entity, target);
+    if (res != BEH_RUNNING)
+      co_return res;
+    co_yield BEH_RUNNING;
+    if (ctx.bb->getVersion<flecs::entity>(entity_bb) != version)
+    {
+      version = ctx.bb->getVersion<flecs::entity>(entity_bb);
+      target = ctx.bb->get<flecs::entity>(entity_bb);
+    }
+  }
+}
+
+static BehTask patrol_task(const BehContext &ctx, size_t ppos_bb, float patrol_dist)
+{
+  uint32_t version = ctx.bb->getVersion<Position>(ppos_bb);
+  Position patrolPos = ctx.bb->get<Position>(ppos_bb);
+  for (;;)
+  {
+    patrol_action(*ctx.ecs, ctx.entity, patrolPos, patrol_dist);
+    co_yield BEH_RUNNING;
+    if (ctx.bb->getVersion<Position>(ppos_bb) != version)
+    {
+      version = ctx.bb->getVersion<Position>(ppos_bb);
+      patrolPos = ctx.bb->get<Position>(ppos_bb);
+    }
+  }
+}
+
+BehNode *move_to_entity_co(flecs::entity entity, const char *bb_name)
+{
+  const size_t entityBb = reg_entity_blackboard_var<flecs::entity>(entity, bb_name);
+  return coroutine_node("MoveToEntityCo", [entityBb](const BehContext &ctx) { return move_to_entity_task(ctx, entityBb); });
+}
+
+BehNode *flee_co(flecs::entity entity, const char *bb_name)
+{
+  const size_t entityBb = reg_entity_blackboard_var<flecs::entity>(entity, bb_name);
+  return coroutine_node("FleeCo", [entityBb](const BehContext &ctx) { return flee_task(ctx, entityBb); });
+}
+
+BehNode *patrol_co(flecs::entity entity, float patrol_dist, const char *bb_name)
+{
+  const size_t pposBb = reg_entity_blackboard_var<Position>(entity, bb_name);
+  entity.set([&](Blackboard &bb, const Position &pos)
+  {
+    bb.set<Position>(pposBb, pos);
+  });
+  return coroutine_node("PatrolCo", [pposBb, patrol_dist](const BehContext &ctx) { return patrol_task(ctx, pposBb, patrol_dist); });
+}
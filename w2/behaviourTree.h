@@ -3,6 +3,8 @@
 #include <flecs.h>
 #include <memory>
 #include "blackboard.h"
+#include "aiProfiler.h"
+#include "aiMemory.h"
 
 enum BehResult
 {
@@ -15,8 +17,18 @@ struct BehNode
 {
   virtual ~BehNode() {}
   virtual BehResult update(flecs::world &ecs, flecs::entity entity, Blackboard &bb) = 0;
+  virtual const char *name() const { return "BehNode"; }
+  // adds the node with its own heap data, nodes owning children pass stats down to them
+  virtual void countMemory(AiMemoryStats &stats) const = 0;
 };
 
+// all node updates should go through this so that they show up in the AI profiler
+inline BehResult update_node(BehNode *node, size_t child_idx, flecs::world &ecs, flecs::entity entity, Blackboard &bb)
+{
+  AiProfileScope profile(node, child_idx);
+  return profile.result(node->update(ecs, entity, bb));
+}
+
 struct BehaviourTree
 {
   std::unique_ptr<BehNode> root = nullptr;
@@ -34,7 +46,13 @@ struct BehaviourTree
 
   void update(flecs::world &ecs, flecs::entity entity, Blackboard &bb)
   {
-    root->update(ecs, entity, bb);
+    update_node(root.get(), 0, ecs, entity, bb);
+  }
+
+  void countMemory(AiMemoryStats &stats) const
+  {
+    if (root)
+      root->countMemory(stats);
   }
 };
 
@@ -19,21 +19,51 @@ public:
     size_t idx = data.size();
     nameIndices.emplace(name, idx);
     data.emplace_back(DataType());
+    versions.push_back(0);
     return idx;
   }
 
+  // writing the same value again keeps the version, so readers only see actual changes
   void set(size_t idx, const DataType &in_data)
   {
+    if (data[idx] == in_data)
+      return;
     data[idx] = in_data;
+    versions[idx]++;
+  }
+
+  uint32_t getVersion(size_t idx) const
+  {
+    return versions[idx];
   }
 
   DataType get(size_t idx) const
   {
     return data[idx];
   }
+
+  size_t size() const
+  {
+    return data.size();
+  }
+
+  // heap bytes, map nodes are estimated with the libstdc++ layout (next pointer, value, cached hash)
+  size_t heapBytes() const
+  {
+    size_t bytes = data.capacity() * sizeof(DataType) + versions.capacity() * sizeof(uint32_t) +
+                   nameIndices.bucket_count() * sizeof(void*);
+    for (const auto &kv : nameIndices)
+    {
+      bytes += sizeof(void*) + sizeof(kv) + sizeof(size_t);
+      if (kv.first.capacity() > 15) // past the small string buffer
+        bytes += kv.first.capacity() + 1;
+    }
+    return bytes;
+  }
 private:
   std::unordered_map<std::string, size_t> nameIndices;
   std::vector<DataType> data;
+  std::vector<uint32_t> versions;
 };
 
 class Blackboard : public NamedDataPool<float>,
@@ -59,5 +89,71 @@ public:
   {
     return NamedDataPool<DataType>::get(idx);
   }
+
+  template<typename DataType>
+  size_t size() const
+  {
+    return NamedDataPool<DataType>::size();
+  }
+
+  template<typename DataType>
+  uint32_t getVersion(size_t idx) const
+  {
+    return NamedDataPool<DataType>::getVersion(idx);
+  }
+
+  template<typename DataType>
+  size_t heapBytes() const
+  {
+    return NamedDataPool<DataType>::heapBytes();
+  }
+};
+
+// Slots a node reads, polled to find out whether any of them changed since the previous poll
+class BbSubscription
+{
+  struct Input
+  {
+    uint32_t (*getVersion)(const Blackboard &bb, size_t idx);
+    size_t idx;
+    uint32_t seenVersion;
+  };
+  std::vector<Input> inputs;
+  bool polled = false;
+
+  template<typename DataType>
+  static uint32_t get_version(const Blackboard &bb, size_t idx) { return bb.getVersion<DataType>(idx); }
+public:
+  template<typename DataType>
+  BbSubscription &add(size_t idx)
+  {
+    inputs.push_back(Input{&get_version<DataType>, idx, 0});
+    return *this;
+  }
+
+  size_t heapBytes() const { return inputs.capacity() * sizeof(Input); }
+
+  // true on the first poll and whenever an input slot was written since the previous one
+  bool poll(const Blackboard &bb)
+  {
+    bool changed = !polled;
+    polled = true;
+    for (Input &input : inputs)
+    {
+      const uint32_t version = input.getVersion(bb, input.idx);
+      changed |= version != input.seenVersion;
+      input.seenVersion = version;
+    }
+    return changed;
+  }
+};
+
+// Blackboard slots mirroring the entity's own state, refreshed once per turn before trees update
+// (update_self_sensors). Values are written through Blackboard::set, so their versions only move
+// when the state actually changes.
+struct SelfSensors
+{
+  size_t hitpointsBb = size_t(-1);
+  size_t positionBb = size_t(-1);
 };
 
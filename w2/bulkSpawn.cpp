@@ -0,0 +1,29 @@
+#include "bulkSpawn.h"
+#include <cassert>
+
+BulkSpawner &BulkSpawner::add(flecs::id_t id, const void *column)
+{
+  for (int32_t i = 0; i < numIds; ++i)
+    if (desc.ids[i] == id)
+    {
+      if (column)
+        columns[i] = const_cast<void*>(column);
+      return *this;
+    }
+  // id list is zero terminated
+  assert(numIds + 1 < ECS_ID_CACHE_SIZE);
+  desc.ids[numIds] = id;
+  columns[numIds] = const_cast<void*>(column);
+  numIds++;
+  return *this;
+}
+
+const flecs::entity_t *BulkSpawner::spawn(int32_t count)
+{
+  if (count <= 0)
+    return nullptr;
+  desc.entities = nullptr;
+  desc.count = count;
+  desc.data = columns;
+  return ecs_bulk_init(ecs.c_ptr(), &desc);
+}
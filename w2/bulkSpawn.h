@@ -0,0 +1,37 @@
+#pragma once
+#include <flecs.h>
+
+// Creates many entities sharing one archetype with a single flecs operation, so they
+// land in their final table directly instead of moving through a table per component.
+// Component data is passed as SoA columns, components without a column are default constructed.
+// Adding an id twice keeps a single entry.
+class BulkSpawner
+{
+  flecs::world &ecs;
+  ecs_bulk_desc_t desc = {};
+  void *columns[ECS_ID_CACHE_SIZE] = {};
+  int32_t numIds = 0;
+public:
+  explicit BulkSpawner(flecs::world &world) : ecs(world) {}
+
+  BulkSpawner &add(flecs::id_t id, const void *column = nullptr);
+
+  template<typename T>
+  BulkSpawner &add(const T *column = nullptr)
+  {
+    return add(ecs.id<T>().raw_id(), column);
+  }
+
+  template<typename Rel>
+  BulkSpawner &addPair(flecs::entity target)
+  {
+    return add(ecs.pair<Rel>(target).raw_id());
+  }
+
+  // Returns ids of the created entities, only valid until the next flecs operation.
+  // Can be called multiple times with different columns for the same archetype.
+  const flecs::entity_t *spawn(int32_t count);
+
+  void setColumn(int32_t idx, const void *column) { columns[idx] = const_cast<void*>(column); }
+  int32_t size() const { return numIds; }
+};
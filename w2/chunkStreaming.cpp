@@ -0,0 +1,340 @@
+#include "chunkStreaming.h"
+#include <algorithm>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "ecsTypes.h"
+#include "dungeonMap.h"
+#include "worldSnapshot.h"
+#include "queryCache.h"
+#include "memoryReport.h"
+
+static constexpr char chunk_magic[4] = {'R', 'G', 'C', 'K'};
+static constexpr uint32_t chunk_version = 1;
+
+// A chunk file is a sequence of segments, one per eviction of the chunk since it was last loaded
+struct ChunkSegmentHeader
+{
+  char magic[4];
+  uint32_t version;
+  int32_t cx;
+  int32_t cy;
+  uint32_t hasWalls;
+  uint32_t snapshotBytes;
+  uint16_t walls[DungeonMap::chunk_size];
+};
+// snapshot columns right after the header have to stay 8 byte aligned
+static_assert(sizeof(ChunkSegmentHeader) % 8 == 0, "chunk segment header breaks snapshot alignment");
+
+static uint64_t chunk_key(int cx, int cy)
+{
+  return uint64_t(uint32_t(cx)) | (uint64_t(uint32_t(cy)) << 32);
+}
+
+static int key_x(uint64_t key) { return int32_t(uint32_t(key)); }
+static int key_y(uint64_t key) { return int32_t(uint32_t(key >> 32)); }
+
+// Single worker thread doing file io, jobs run in submission order so a read
+// always sees every segment appended before it was requested
+class ChunkIo
+{
+public:
+  using Loaded = std::pair<uint64_t, std::vector<uint8_t>>;
+
+  explicit ChunkIo(std::string dir) : directory(std::move(dir)), worker([this] { run(); }) {}
+
+  ~ChunkIo()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    cv.notify_one();
+    worker.join();
+  }
+
+  // truncate starts the file over instead of appending to it
+  void write(uint64_t key, std::vector<uint8_t> &&bytes, bool truncate)
+  {
+    push(Job{key, false, truncate, std::move(bytes)});
+  }
+
+  // the file is removed once read, its contents come back through takeLoaded
+  void read(uint64_t key)
+  {
+    push(Job{key, true, false, {}});
+  }
+
+  // blocks until every job submitted so far is done
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return jobs.empty() && !busy; });
+  }
+
+  void takeLoaded(std::vector<Loaded> &out)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    out.swap(loaded);
+    loaded.clear();
+  }
+
+private:
+  struct Job
+  {
+    uint64_t key;
+    bool read;
+    bool truncate;
+    std::vector<uint8_t> bytes;
+  };
+
+  std::string directory;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::condition_variable idle;
+  std::deque<Job> jobs;
+  std::vector<Loaded> loaded;
+  bool busy = false;
+  bool quit = false;
+  std::thread worker; // last, it starts running in the constructor
+
+  void push(Job &&job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(std::move(job));
+    }
+    cv.notify_one();
+  }
+
+  std::string path(uint64_t key) const
+  {
+    return directory + "/" + std::to_string(key_x(key)) + "_" + std::to_string(key_y(key)) + ".chunk";
+  }
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+      cv.wait(lock, [this] { return quit || !jobs.empty(); });
+      // pending writes are still flushed when quitting
+      if (jobs.empty())
+        return;
+      Job job = std::move(jobs.front());
+      jobs.pop_front();
+      busy = true;
+      lock.unlock();
+      const std::string file = path(job.key);
+      if (job.read)
+        job.bytes = read_file(file);
+      else if (!write_file(file, job.bytes, job.truncate))
+        fprintf(stderr, "cannot write chunk file '%s'\n", file.c_str());
+      lock.lock();
+      if (job.read)
+        loaded.emplace_back(job.key, std::move(job.bytes));
+      busy = false;
+      if (jobs.empty())
+        idle.notify_all();
+    }
+  }
+
+  static std::vector<uint8_t> read_file(const std::string &file)
+  {
+    std::vector<uint8_t> bytes;
+    FILE *f = fopen(file.c_str(), "rb");
+    if (!f)
+      return bytes;
+    uint8_t buf[4096];
+    for (size_t len; (len = fread(buf, 1, sizeof(buf), f)) > 0;)
+      bytes.insert(bytes.end(), buf, buf + len);
+    fclose(f);
+    remove(file.c_str());
+    return bytes;
+  }
+
+  static bool write_file(const std::string &file, const std::vector<uint8_t> &bytes, bool truncate)
+  {
+    FILE *f = fopen(file.c_str(), truncate ? "wb" : "ab");
+    if (!f)
+      return false;
+    const bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    return fclose(f) == 0 && ok;
+  }
+};
+
+struct ChunkStreaming
+{
+  int residentRadius = 2;
+  std::unique_ptr<ChunkIo> io;
+  std::unordered_set<uint64_t> stored;  // chunks having a file
+  std::unordered_set<uint64_t> loading; // read requested but not applied, never evicted meanwhile
+
+  // scratch reused between turns
+  std::unordered_map<uint64_t, std::vector<flecs::entity_t>> evicted;
+  std::vector<ChunkIo::Loaded> loaded;
+};
+
+size_t chunk_streaming_memory_bytes(flecs::world &ecs)
+{
+  const ChunkStreaming *streaming = ecs.get<ChunkStreaming>();
+  if (!streaming)
+    return 0;
+  size_t bytes = sizeof(ChunkStreaming) + sizeof(ChunkIo) + heap_bytes(streaming->stored) +
+                 heap_bytes(streaming->loading) + heap_bytes(streaming->evicted) + heap_bytes(streaming->loaded);
+  for (const auto &[key, entities] : streaming->evicted)
+    bytes += heap_bytes(entities);
+  return bytes;
+}
+
+void enable_chunk_streaming(flecs::world &ecs, int resident_radius, const char *directory)
+{
+  std::error_code ec;
+  std::filesystem::create_directories(directory, ec);
+  ChunkStreaming streaming;
+  streaming.residentRadius = resident_radius;
+  streaming.io = std::make_unique<ChunkIo>(directory);
+  ecs.set(std::move(streaming));
+}
+
+static void apply_loaded_chunks(flecs::world &ecs, ChunkStreaming &streaming)
+{
+  streaming.io->takeLoaded(streaming.loaded);
+  DungeonMap &map = *ecs.get_mut<DungeonMap>();
+  for (const auto &[key, bytes] : streaming.loaded)
+  {
+    for (size_t offset = 0; offset + sizeof(ChunkSegmentHeader) <= bytes.size();)
+    {
+      ChunkSegmentHeader header;
+      memcpy(&header, bytes.data() + offset, sizeof(header));
+      offset += sizeof(header);
+      if (memcmp(header.magic, chunk_magic, sizeof(chunk_magic)) != 0 || header.version != chunk_version ||
+          header.snapshotBytes > bytes.size() - offset)
+      {
+        fprintf(stderr, "chunk %d %d is corrupted\n", key_x(key), key_y(key));
+        break;
+      }
+      if (header.hasWalls)
+      {
+        // walls placed into the chunk after it was evicted stay
+        uint16_t rows[DungeonMap::chunk_size] = {};
+        map.getChunk(header.cx, header.cy, rows);
+        for (int y = 0; y < DungeonMap::chunk_size; ++y)
+          rows[y] |= header.walls[y];
+        map.setChunk(header.cx, header.cy, rows);
+      }
+      if (!load_entities_snapshot(ecs, bytes.data() + offset, header.snapshotBytes, "chunk"))
+        fprintf(stderr, "chunk %d %d has an incompatible snapshot\n", key_x(key), key_y(key));
+      offset += header.snapshotBytes;
+    }
+    streaming.stored.erase(key);
+    streaming.loading.erase(key);
+  }
+  streaming.loaded.clear();
+}
+
+static void evict_far_chunks(flecs::world &ecs, ChunkStreaming &streaming, int pcx, int pcy)
+{
+  // one chunk of slack so walking along a chunk border doesn't thrash files
+  const int keepRadius = streaming.residentRadius + 1;
+  auto isFar = [&](int cx, int cy)
+  {
+    return std::max(abs(cx - pcx), abs(cy - pcy)) > keepRadius && !streaming.loading.count(chunk_key(cx, cy));
+  };
+
+  auto &streamedQuery = cached_query<struct StreamedEntitiesQuery>(ecs, [&]
+  {
+    return ecs.query_builder<const Position>()
+      .term<IsPlayer>().not_()
+      .build();
+  });
+  streamedQuery.each([&](flecs::entity e, const Position &pos)
+  {
+    const int cx = pos.x >> DungeonMap::chunk_shift;
+    const int cy = pos.y >> DungeonMap::chunk_shift;
+    if (isFar(cx, cy))
+      streaming.evicted[chunk_key(cx, cy)].push_back(e.id());
+  });
+  DungeonMap &map = *ecs.get_mut<DungeonMap>();
+  map.forEachChunk([&](int cx, int cy)
+  {
+    if (isFar(cx, cy))
+      streaming.evicted[chunk_key(cx, cy)];
+  });
+
+  for (auto &[key, entities] : streaming.evicted)
+  {
+    ChunkSegmentHeader header = {};
+    memcpy(header.magic, chunk_magic, sizeof(chunk_magic));
+    header.version = chunk_version;
+    header.cx = key_x(key);
+    header.cy = key_y(key);
+    header.hasWalls = map.getChunk(header.cx, header.cy, header.walls);
+    std::vector<uint8_t> bytes(sizeof(header));
+    save_entities_snapshot(ecs, entities.data(), entities.size(), bytes);
+    header.snapshotBytes = uint32_t(bytes.size() - sizeof(header));
+    memcpy(bytes.data(), &header, sizeof(header));
+
+    const bool firstSegment = streaming.stored.insert(key).second;
+    streaming.io->write(key, std::move(bytes), firstSegment);
+    map.releaseChunk(header.cx, header.cy);
+    for (flecs::entity_t e : entities)
+      ecs.entity(e).destruct();
+  }
+  streaming.evicted.clear();
+}
+
+void load_streamed_chunks(flecs::world &ecs)
+{
+  if (!ecs.has<ChunkStreaming>())
+    return;
+  ChunkStreaming &streaming = *ecs.get_mut<ChunkStreaming>();
+  for (uint64_t key : streaming.stored)
+    if (streaming.loading.insert(key).second)
+      streaming.io->read(key);
+  streaming.io->wait();
+  apply_loaded_chunks(ecs, streaming);
+}
+
+void update_chunk_streaming(flecs::world &ecs)
+{
+  if (!ecs.has<ChunkStreaming>())
+    return;
+  ChunkStreaming &streaming = *ecs.get_mut<ChunkStreaming>();
+  apply_loaded_chunks(ecs, streaming);
+
+  auto &playerQuery = cached_query<const Position, const IsPlayer>(ecs);
+  bool hasPlayer = false;
+  int pcx = 0;
+  int pcy = 0;
+  playerQuery.each([&](const Position &pos, const IsPlayer &)
+  {
+    hasPlayer = true;
+    pcx = pos.x >> DungeonMap::chunk_shift;
+    pcy = pos.y >> DungeonMap::chunk_shift;
+  });
+  // nothing to stream around once the player is dead
+  if (!hasPlayer)
+    return;
+
+  const int radius = streaming.residentRadius;
+  for (int cy = pcy - radius; cy <= pcy + radius; ++cy)
+    for (int cx = pcx - radius; cx <= pcx + radius; ++cx)
+    {
+      const uint64_t key = chunk_key(cx, cy);
+      if (streaming.stored.count(key) && streaming.loading.insert(key).second)
+        streaming.io->read(key);
+    }
+  evict_far_chunks(ecs, streaming, pcx, pcy);
+}
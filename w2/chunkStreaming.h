@@ -0,0 +1,21 @@
+#pragma once
+#include <flecs.h>
+
+// Chunk streaming keeps only the part of the dungeon around the player in the world. The map is cut
+// into DungeonMap chunks, chunks within the resident radius (in chunks, around the player's one) are
+// loaded and simulated. Chunks further than one more chunk away are evicted: their walls and every
+// entity standing in them (except the player) are serialized into a chunk file, walls and snapshot
+// columns (see worldSnapshot.h), then removed from the world. Files are written and read back on a
+// background thread; a chunk coming back into range is respawned on the turn after its read completes.
+// Entities wandering into an evicted chunk are evicted as well, appended to its file.
+
+// Starts streaming into directory (created if missing), restarts it if it was running.
+// Files of a previous run in the directory are overwritten as chunks get evicted.
+void enable_chunk_streaming(flecs::world &ecs, int resident_radius, const char *directory);
+// Reads every evicted chunk back into the world right away, does nothing unless streaming was enabled.
+// Full snapshots don't store walls nor evicted chunks, the whole dungeon has to be resident around them.
+void load_streamed_chunks(flecs::world &ecs);
+// Called once a turn, does nothing unless streaming was enabled
+void update_chunk_streaming(flecs::world &ecs);
+// chunk bookkeeping and buffers of reads not applied yet
+size_t chunk_streaming_memory_bytes(flecs::world &ecs);
@@ -0,0 +1,186 @@
+#include "dormancy.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "ecsTypes.h"
+#include "aiArchetypes.h"
+#include "queryCache.h"
+#include "math.h"
+#include "memoryReport.h"
+
+// regions are at least wake_radius wide, so the 3x3 block around a cell covers its wake radius
+static constexpr int region_shift = 4;
+static_assert((1 << region_shift) >= wake_radius, "regions have to cover the wake radius");
+
+static uint64_t region_key(int rx, int ry)
+{
+  return uint64_t(uint32_t(rx)) | (uint64_t(uint32_t(ry)) << 32);
+}
+
+struct DormantEntry
+{
+  flecs::entity_t entity;
+  Position pos;
+  Team team;
+};
+
+struct ActorEntry
+{
+  Position pos;
+  Team team;
+};
+
+// dormant agents by region, maintained by observers on the tag
+struct WakeIndex
+{
+  std::unordered_map<uint64_t, std::vector<DormantEntry>> dormant;
+
+  // scratch reused between turns
+  std::unordered_map<uint64_t, std::vector<ActorEntry>> actors;
+  std::vector<flecs::entity_t> changed;
+};
+
+static uint64_t region_of(const Position &pos)
+{
+  return region_key(pos.x >> region_shift, pos.y >> region_shift);
+}
+
+static WakeIndex *get_index(flecs::world ecs)
+{
+  // observers also fire while the world is torn down, don't recreate the singleton then
+  return ecs.has<WakeIndex>() ? ecs.get_mut<WakeIndex>() : nullptr;
+}
+
+void register_dormancy(flecs::world &ecs)
+{
+  ecs.set(WakeIndex{});
+  ecs.observer<const Position, const Team>()
+    .term<Dormant>()
+    .event(flecs::OnAdd)
+    .each([](flecs::entity e, const Position &pos, const Team &team)
+    {
+      if (WakeIndex *index = get_index(e.world()))
+        index->dormant[region_of(pos)].push_back(DormantEntry{e.id(), pos, team});
+    });
+  // fires when woken and when a dormant agent is deleted or streamed out
+  ecs.observer<const Position, const Team>()
+    .term<Dormant>()
+    .event(flecs::OnRemove)
+    .each([](flecs::entity e, const Position &pos, const Team &)
+    {
+      WakeIndex *index = get_index(e.world());
+      if (!index)
+        return;
+      auto itf = index->dormant.find(region_of(pos));
+      if (itf == index->dormant.end())
+        return;
+      std::vector<DormantEntry> &entries = itf->second;
+      entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                   [&](const DormantEntry &entry) { return entry.entity == e.id(); }),
+                    entries.end());
+      if (entries.empty())
+        index->dormant.erase(itf);
+    });
+}
+
+template<typename Callable>
+static void for_each_region_around(const Position &pos, Callable c)
+{
+  const int rx = pos.x >> region_shift;
+  const int ry = pos.y >> region_shift;
+  for (int y = ry - 1; y <= ry + 1; ++y)
+    for (int x = rx - 1; x <= rx + 1; ++x)
+      c(region_key(x, y));
+}
+
+static bool within_wake_radius(const Position &a, const Position &b)
+{
+  return sqr(a.x - b.x) + sqr(a.y - b.y) <= sqr(wake_radius);
+}
+
+static void wake_agents(flecs::world &ecs, WakeIndex &index)
+{
+  auto &awakeQuery = cached_query<struct AwakeActorsQuery>(ecs, [&]
+  {
+    return ecs.query_builder<const Position, const Team>()
+      .term<Dormant>().not_()
+      .build();
+  });
+  if (index.dormant.empty())
+    return;
+  awakeQuery.each([&](const Position &pos, const Team &team)
+  {
+    for_each_region_around(pos, [&](uint64_t key)
+    {
+      auto itf = index.dormant.find(key);
+      if (itf == index.dormant.end())
+        return;
+      for (const DormantEntry &entry : itf->second)
+        if (entry.team.team != team.team && within_wake_radius(entry.pos, pos))
+          index.changed.push_back(entry.entity);
+    });
+  });
+  // the observer drops them from the index, an agent near several enemies is listed more than once
+  for (flecs::entity_t e : index.changed)
+    ecs.entity(e).remove<Dormant>();
+  index.changed.clear();
+}
+
+static void put_agents_to_sleep(flecs::world &ecs, WakeIndex &index)
+{
+  auto &actorsQuery = cached_query<const Position, const Team, const Hitpoints>(ecs);
+  auto &agentsQuery = cached_query<struct SleepCandidatesQuery>(ecs, [&]
+  {
+    return ecs.query_builder<const Position, const Team, const AiArchetype>()
+      .term<Dormant>().not_()
+      .term<IsPlayer>().not_()
+      .build();
+  });
+
+  index.actors.clear();
+  actorsQuery.each([&](const Position &pos, const Team &team, const Hitpoints &)
+  {
+    index.actors[region_of(pos)].push_back(ActorEntry{pos, team});
+  });
+
+  agentsQuery.each([&](flecs::entity e, const Position &pos, const Team &team, const AiArchetype &)
+  {
+    bool enemyNear = false;
+    for_each_region_around(pos, [&](uint64_t key)
+    {
+      auto itf = index.actors.find(key);
+      if (itf == index.actors.end())
+        return;
+      for (const ActorEntry &actor : itf->second)
+        enemyNear = enemyNear || (actor.team.team != team.team && within_wake_radius(actor.pos, pos));
+    });
+    if (!enemyNear)
+      index.changed.push_back(e.id());
+  });
+  for (flecs::entity_t e : index.changed)
+    ecs.entity(e).add<Dormant>();
+  index.changed.clear();
+}
+
+size_t wake_index_memory_bytes(flecs::world &ecs)
+{
+  const WakeIndex *index = ecs.get<WakeIndex>();
+  if (!index)
+    return 0;
+  size_t bytes = sizeof(WakeIndex) + heap_bytes(index->dormant) + heap_bytes(index->actors) + heap_bytes(index->changed);
+  for (const auto &[key, entries] : index->dormant)
+    bytes += heap_bytes(entries);
+  for (const auto &[key, actors] : index->actors)
+    bytes += heap_bytes(actors);
+  return bytes;
+}
+
+void update_dormancy(flecs::world &ecs)
+{
+  WakeIndex &index = *ecs.get_mut<WakeIndex>();
+  wake_agents(ecs, index);
+  // counted in planning ticks, TurnCounter also advances on turns when only the player acts
+  const PlanTickCounter *counter = ecs.get<PlanTickCounter>();
+  if (counter && counter->tick % dormancy_check_period == 0)
+    put_agents_to_sleep(ecs, index);
+}
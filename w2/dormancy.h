@@ -0,0 +1,18 @@
+#pragma once
+#include <flecs.h>
+
+// Sleep/wake scheduling for AI agents. An agent with no enemy within wake_radius gets the Dormant tag,
+// which keeps it out of FSM/behaviour tree/utility/GOAP/MCTS updates and field of view scans. Dormant
+// agents are put into a coarse region index; every turn each awake actor checks the regions around it
+// and wakes the dormant enemies within wake_radius. Dormant agents don't move, so their index entries
+// stay valid, and the per turn cost follows the awake actors instead of the whole population.
+
+// past the field of view with room for an enemy's moves within a turn, so agents wake before they could see it
+static constexpr int wake_radius = 10;
+// agents are only put to sleep every this many planning ticks (PlanTickCounter), waking is checked on every one
+static constexpr uint64_t dormancy_check_period = 4;
+
+void register_dormancy(flecs::world &ecs);
+size_t wake_index_memory_bytes(flecs::world &ecs);
+// Called before agents plan their actions
+void update_dormancy(flecs::world &ecs);
@@ -0,0 +1,71 @@
+#include "dungeonMap.h"
+#include <algorithm>
+#include <iterator>
+#include "memoryReport.h"
+
+bool DungeonMap::isWall(int x, int y) const
+{
+  auto itf = chunks.find(chunk_key(x >> chunk_shift, y >> chunk_shift));
+  if (itf == chunks.end())
+    return false;
+  return itf->second.rows[y & (chunk_size - 1)] & (1u << (x & (chunk_size - 1)));
+}
+
+void DungeonMap::setWall(int x, int y, bool wall)
+{
+  Chunk &chunk = chunks[chunk_key(x >> chunk_shift, y >> chunk_shift)];
+  uint16_t &row = chunk.rows[y & (chunk_size - 1)];
+  const uint16_t bit = uint16_t(1u << (x & (chunk_size - 1)));
+  const uint16_t newRow = wall ? uint16_t(row | bit) : uint16_t(row & ~bit);
+  if (newRow == row)
+    return;
+  row = newRow;
+  chunk.version++;
+}
+
+uint64_t DungeonMap::areaVersion(int x0, int y0, int x1, int y1) const
+{
+  uint64_t res = releasedVersions;
+  for (int cy = y0 >> chunk_shift; cy <= (y1 >> chunk_shift); ++cy)
+    for (int cx = x0 >> chunk_shift; cx <= (x1 >> chunk_shift); ++cx)
+    {
+      auto itf = chunks.find(chunk_key(cx, cy));
+      if (itf != chunks.end())
+        res += itf->second.version;
+    }
+  return res;
+}
+
+bool DungeonMap::getChunk(int cx, int cy, uint16_t (&rows)[chunk_size]) const
+{
+  auto itf = chunks.find(chunk_key(cx, cy));
+  if (itf == chunks.end())
+    return false;
+  std::copy(std::begin(itf->second.rows), std::end(itf->second.rows), rows);
+  return true;
+}
+
+void DungeonMap::setChunk(int cx, int cy, const uint16_t (&rows)[chunk_size])
+{
+  Chunk &chunk = chunks[chunk_key(cx, cy)];
+  if (!std::equal(std::begin(rows), std::end(rows), chunk.rows))
+  {
+    std::copy(std::begin(rows), std::end(rows), chunk.rows);
+    chunk.version++;
+  }
+}
+
+void DungeonMap::releaseChunk(int cx, int cy)
+{
+  auto itf = chunks.find(chunk_key(cx, cy));
+  if (itf == chunks.end())
+    return;
+  // sums over the chunk drop by its version, the bump keeps every sum moving forward instead
+  releasedVersions += itf->second.version + 1;
+  chunks.erase(itf);
+}
+
+size_t DungeonMap::heapBytes() const
+{
+  return heap_bytes(chunks);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <flecs.h>
+
+// Sparse wall map stored in 16x16 chunks, one bit per tile. Every chunk has a version that is
+// bumped on change so cached data (e.g. field of view) can tell when tiles around it changed.
+class DungeonMap
+{
+public:
+  static constexpr int chunk_shift = 4;
+  static constexpr int chunk_size = 1 << chunk_shift;
+
+  bool isWall(int x, int y) const;
+  void setWall(int x, int y, bool wall);
+  // sum of versions of all chunks overlapping the rect, changes whenever any tile inside does
+  uint64_t areaVersion(int x0, int y0, int x1, int y1) const;
+
+  // Whole chunk access by chunk coordinates, for streaming. getChunk returns false for chunks never set.
+  bool getChunk(int cx, int cy, uint16_t (&rows)[chunk_size]) const;
+  void setChunk(int cx, int cy, const uint16_t (&rows)[chunk_size]);
+  // Frees chunk storage, areaVersion of every area still changes so caches over it get invalidated
+  void releaseChunk(int cx, int cy);
+
+  // chunk storage, estimated like other hash maps in the memory report
+  size_t heapBytes() const;
+
+  template<typename Callable>
+  void forEachChunk(Callable c) const
+  {
+    for (const auto &[key, chunk] : chunks)
+      c(int(int32_t(uint32_t(key))), int(int32_t(uint32_t(key >> 32))));
+  }
+
+  template<typename Callable>
+  void forEachWall(Callable c) const
+  {
+    for (const auto &[key, chunk] : chunks)
+    {
+      const int cx = int(int32_t(uint32_t(key))) << chunk_shift;
+      const int cy = int(int32_t(uint32_t(key >> 32))) << chunk_shift;
+      for (int y = 0; y < chunk_size; ++y)
+        for (int x = 0; x < chunk_size; ++x)
+          if (chunk.rows[y] & (1u << x))
+            c(cx + x, cy + y);
+    }
+  }
+
+private:
+  struct Chunk
+  {
+    uint16_t rows[chunk_size] = {};
+    uint64_t version = 0;
+  };
+  std::unordered_map<uint64_t, Chunk> chunks;
+  uint64_t releasedVersions = 0;
+
+  static uint64_t chunk_key(int cx, int cy)
+  {
+    return uint64_t(uint32_t(cx)) | (uint64_t(uint32_t(cy)) << 32);
+  }
+};
+
+inline bool is_wall(const flecs::world &ecs, int x, int y)
+{
+  const DungeonMap *map = ecs.get<DungeonMap>();
+  return map && map->isWall(x, y);
+}
@@ -1,20 +1,66 @@
 #pragma once
+#include <cstdint>
+
+// Compact layout (cmake -Dcompact_types=ON) stores coordinates in 16 bits (maps within +-32767)
+// and actions/teams in 8 bits, so more actors fit a cache line in the combat loops. Fields still
+// read and write as ints, values out of range wrap around.
+#ifdef COMPACT_TYPES
+template<typename Storage>
+struct PackedInt
+{
+  Storage value = 0;
+
+  PackedInt() = default;
+  PackedInt(int v) : value(static_cast<Storage>(v)) {}
+  operator int() const { return value; }
+
+  PackedInt &operator=(int v)
+  {
+    value = static_cast<Storage>(v);
+    return *this;
+  }
+  PackedInt &operator+=(int v) { return *this = value + v; }
+  PackedInt &operator-=(int v) { return *this = value - v; }
+  PackedInt &operator++() { return *this += 1; }
+  PackedInt &operator--() { return *this -= 1; }
+  PackedInt operator++(int)
+  {
+    const PackedInt prev = *this;
+    ++*this;
+    return prev;
+  }
+  PackedInt operator--(int)
+  {
+    const PackedInt prev = *this;
+    --*this;
+    return prev;
+  }
+};
+
+using coord_t = PackedInt<int16_t>;
+using action_t = PackedInt<uint8_t>;
+using team_t = PackedInt<uint8_t>;
+#else
+using coord_t = int;
+using action_t = int;
+using team_t = int;
+#endif
 
 struct Position;
 struct MovePos;
 
 struct MovePos
 {
-  int x = 0;
-  int y = 0;
+  coord_t x = 0;
+  coord_t y = 0;
 
   MovePos &operator=(const Position &rhs);
 };
 
 struct Position
 {
-  int x = 0;
-  int y = 0;
+  coord_t x = 0;
+  coord_t y = 0;
 
   Position &operator=(const MovePos &rhs);
 };
@@ -40,10 +86,11 @@ inline bool operator==(const MovePos &lhs, const Position &rhs) { return lhs.x =
 inline bool operator!=(const Position &lhs, const Position &rhs) { return !(lhs == rhs); };
 
 
+// cold: only read by patrolling behaviours
 struct PatrolPos
 {
-  int x = 0;
-  int y = 0;
+  coord_t x = 0;
+  coord_t y = 0;
 };
 
 struct Hitpoints
@@ -66,9 +113,10 @@ enum Actions
 
 struct Action
 {
-  int action = 0;
+  action_t action = 0;
 };
 
+// cold: only read once per turn for the player
 struct NumActions
 {
   int numActions = 1;
@@ -105,10 +153,33 @@ struct Symbol
 
 struct IsPlayer {};
 
+// can collect heals and powerups
+struct CanPickup {};
+
+// AI agent with no enemy around, skipped by planning and perception until woken (see dormancy.h)
+struct Dormant {};
+
 struct Team
 {
-  int team = 0;
+  team_t team = 0;
 };
 
 struct TextureSource {};
 
+// world singletons, random streams of agents are keyed by them
+struct WorldSeed
+{
+  uint64_t seed = 0;
+};
+
+struct TurnCounter
+{
+  uint64_t turn = 0;
+};
+
+// Turns on which npcs plan their actions, TurnCounter advances on every player action and
+// a player with several actions per turn lets npcs plan only on some of them
+struct PlanTickCounter
+{
+  uint64_t tick = 0;
+};
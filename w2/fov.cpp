@@ -0,0 +1,110 @@
+#include "fov.h"
+#include "dungeonMap.h"
+#include "math.h"
+#include "queryCache.h"
+
+struct ShadowCaster
+{
+  const DungeonMap *map;
+  FieldOfView &fov;
+
+  void mark(int dx, int dy)
+  {
+    if (sqr(dx) + sqr(dy) <= sqr(fov_radius))
+      fov.visible.set(size_t((dy + fov_radius) * fov_size + dx + fov_radius));
+  }
+
+  bool blocks(int dx, int dy) const
+  {
+    return map && map->isWall(fov.origin.x + dx, fov.origin.y + dy);
+  }
+
+  // scans one octant row by row, xx/xy/yx/yy map octant coordinates to map offsets
+  void castLight(int row, float startSlope, float endSlope, int xx, int xy, int yx, int yy)
+  {
+    if (startSlope < endSlope)
+      return;
+    float nextStart = startSlope;
+    for (int i = row; i <= fov_radius; ++i)
+    {
+      bool blocked = false;
+      for (int dx = -i, dy = -i; dx <= 0; ++dx)
+      {
+        const float leftSlope = (float(dx) - 0.5f) / (float(dy) + 0.5f);
+        const float rightSlope = (float(dx) + 0.5f) / (float(dy) - 0.5f);
+        if (startSlope < rightSlope)
+          continue;
+        if (endSlope > leftSlope)
+          break;
+        const int mx = dx * xx + dy * xy;
+        const int my = dx * yx + dy * yy;
+        mark(mx, my);
+        if (blocked)
+        {
+          if (blocks(mx, my))
+            nextStart = rightSlope;
+          else
+          {
+            blocked = false;
+            startSlope = nextStart;
+          }
+        }
+        else if (blocks(mx, my) && i < fov_radius)
+        {
+          blocked = true;
+          castLight(i + 1, startSlope, leftSlope, xx, xy, yx, yy);
+          nextStart = rightSlope;
+        }
+      }
+      if (blocked)
+        break;
+    }
+  }
+
+  void compute()
+  {
+    static constexpr int octants[8][4] =
+    {
+      {1, 0, 0, 1}, {0, 1, 1, 0}, {0, -1, 1, 0}, {-1, 0, 0, 1},
+      {-1, 0, 0, -1}, {0, -1, -1, 0}, {0, 1, -1, 0}, {1, 0, 0, -1}
+    };
+    fov.visible.reset();
+    mark(0, 0);
+    for (const auto &oct : octants)
+      castLight(1, 1.f, 0.f, oct[0], oct[1], oct[2], oct[3]);
+  }
+};
+
+void update_fields_of_view(flecs::world &ecs)
+{
+  auto &viewersQuery = cached_query<struct AwakeViewersQuery>(ecs, [&]
+  {
+    return ecs.query_builder<const Position, FieldOfView>()
+      .term<Dormant>().not_()
+      .build();
+  });
+  const DungeonMap *map = ecs.get<DungeonMap>();
+  viewersQuery.each([&](const Position &pos, FieldOfView &fov)
+  {
+    const uint64_t version = map ? map->areaVersion(pos.x - fov_radius, pos.y - fov_radius,
+                                                    pos.x + fov_radius, pos.y + fov_radius) : 0;
+    if (fov.valid && fov.origin == pos && fov.mapVersion == version)
+      return;
+    fov.origin = pos;
+    fov.mapVersion = version;
+    fov.valid = true;
+    ShadowCaster{map, fov}.compute();
+  });
+}
+
+bool can_see(flecs::entity viewer, const Position &pos)
+{
+  const FieldOfView *fov = viewer.get<FieldOfView>();
+  return !fov || fov->canSee(pos);
+}
+
+bool can_see(flecs::entity viewer, flecs::entity target)
+{
+  const Position *pos = target.get<Position>();
+  return pos && can_see(viewer, *pos);
+}
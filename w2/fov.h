@@ -0,0 +1,32 @@
+#pragma once
+#include <bitset>
+#include <flecs.h>
+#include "ecsTypes.h"
+
+// Recursive shadowcasting over DungeonMap walls. Results are cached per entity as a bitset over the
+// square around it and only recomputed when the entity moves or a wall near it changes.
+
+static constexpr int fov_radius = 6;
+static constexpr int fov_size = fov_radius * 2 + 1;
+
+struct FieldOfView
+{
+  Position origin;
+  uint64_t mapVersion = 0;
+  bool valid = false;
+  std::bitset<fov_size * fov_size> visible;
+
+  bool canSee(const Position &pos) const
+  {
+    const int x = pos.x - origin.x + fov_radius;
+    const int y = pos.y - origin.y + fov_radius;
+    if (!valid || x < 0 || y < 0 || x >= fov_size || y >= fov_size)
+      return false;
+    return visible[size_t(y * fov_size + x)];
+  }
+};
+
+void update_fields_of_view(flecs::world &ecs);
+// entities without FieldOfView see everything, keeps perception working for non-AI actors
+bool can_see(flecs::entity viewer, const Position &pos);
+bool can_see(flecs::entity viewer, flecs::entity target);
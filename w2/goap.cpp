@@ -0,0 +1,261 @@
+#include "goap.h"
+#include <algorithm>
+#include <bit>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+#include "ecsTypes.h"
+#include "aiUtils.h"
+#include "rng.h"
+#include "influenceMap.h"
+#include "targetGrid.h"
+#include "queryCache.h"
+#include "memoryReport.h"
+
+enum GoapActionType : uint8_t
+{
+  GA_ATTACK = 0,
+  GA_ATTACK_POWERED,
+  GA_FLEE,
+  GA_GO_HEAL,
+  GA_GO_POWERUP,
+  GA_NUM
+};
+
+// action is applicable when (state & preMask) == preValue, applying it sets effMask bits to effValue
+struct GoapActionDesc
+{
+  GoapState preMask;
+  GoapState preValue;
+  GoapState effMask;
+  GoapState effValue;
+  float cost;
+};
+
+static constexpr GoapState fact(GoapFact f) { return 1u << f; }
+
+static const GoapActionDesc actions[GA_NUM] =
+{
+  // attack: enemy around and we're fine
+  {fact(GF_ENEMY_NEAR) | fact(GF_LOW_HP), fact(GF_ENEMY_NEAR), fact(GF_ENEMY_NEAR), 0, 2.f},
+  // powered up agents fight even when hurt
+  {fact(GF_ENEMY_NEAR) | fact(GF_POWERED_UP), fact(GF_ENEMY_NEAR) | fact(GF_POWERED_UP), fact(GF_ENEMY_NEAR), 0, 2.f},
+  // flee: always possible, but expensive
+  {fact(GF_ENEMY_NEAR), fact(GF_ENEMY_NEAR), fact(GF_ENEMY_NEAR), 0, 5.f},
+  // go heal
+  {fact(GF_HEAL_AVAILABLE) | fact(GF_LOW_HP), fact(GF_HEAL_AVAILABLE) | fact(GF_LOW_HP),
+   fact(GF_HEAL_AVAILABLE) | fact(GF_LOW_HP), 0, 1.f},
+  // go powerup
+  {fact(GF_POWERUP_AVAILABLE), fact(GF_POWERUP_AVAILABLE),
+   fact(GF_POWERUP_AVAILABLE) | fact(GF_POWERED_UP), fact(GF_POWERED_UP), 1.f},
+};
+
+struct GoapGoalDesc
+{
+  GoapState mask;
+  GoapState value;
+};
+
+static const GoapGoalDesc goals[GG_NUM] =
+{
+  {fact(GF_ENEMY_NEAR) | fact(GF_LOW_HP), 0},
+  {fact(GF_ENEMY_NEAR), 0},
+};
+
+// thresholds used to derive facts from components
+static constexpr float sense_radius = 5.f;
+static constexpr float low_hp = 50.f;
+static constexpr float powered_up_damage = 30.f;
+static constexpr float patrol_dist = 2.f;
+static constexpr size_t max_plan_length = 8;
+
+struct GoapPlan
+{
+  std::vector<uint8_t> actions;
+  std::vector<GoapState> states; // expected facts after each action
+};
+
+struct GoapPlanCache
+{
+  std::unordered_map<uint64_t, uint32_t> index;
+  std::vector<GoapPlan> plans;
+};
+
+static float heuristic(GoapState state, const GoapGoalDesc &goal)
+{
+  // cheapest action fixes at most max effect bits at once, this keeps the estimate admissible
+  static const float scale = []
+  {
+    float minCost = actions[0].cost;
+    int maxBits = 1;
+    for (const GoapActionDesc &act : actions)
+    {
+      minCost = std::min(minCost, act.cost);
+      maxBits = std::max(maxBits, std::popcount(act.effMask));
+    }
+    return minCost / float(maxBits);
+  }();
+  return float(std::popcount((state ^ goal.value) & goal.mask)) * scale;
+}
+
+static GoapPlan find_plan(GoapState start, const GoapGoalDesc &goal)
+{
+  struct Node
+  {
+    float cost;
+    float estimate;
+    GoapState state;
+    bool operator<(const Node &rhs) const { return estimate > rhs.estimate; }
+  };
+  struct Visit
+  {
+    float cost;
+    GoapState prev;
+    uint8_t action;
+    uint8_t depth;
+  };
+  std::priority_queue<Node> open;
+  std::unordered_map<GoapState, Visit> visited;
+  open.push(Node{0.f, heuristic(start, goal), start});
+  visited[start] = Visit{0.f, start, GA_NUM, 0};
+
+  GoapPlan plan;
+  while (!open.empty())
+  {
+    const Node node = open.top();
+    open.pop();
+    const Visit nodeVisit = visited[node.state];
+    if (node.cost > nodeVisit.cost)
+      continue; // stale entry
+    if ((node.state & goal.mask) == goal.value)
+    {
+      for (GoapState state = node.state; state != start; state = visited[state].prev)
+      {
+        plan.actions.push_back(visited[state].action);
+        plan.states.push_back(state);
+      }
+      std::reverse(plan.actions.begin(), plan.actions.end());
+      std::reverse(plan.states.begin(), plan.states.end());
+      return plan;
+    }
+    if (nodeVisit.depth >= max_plan_length)
+      continue;
+    const uint8_t depth = uint8_t(nodeVisit.depth + 1);
+    for (uint8_t i = 0; i < GA_NUM; ++i)
+    {
+      const GoapActionDesc &act = actions[i];
+      if ((node.state & act.preMask) != act.preValue)
+        continue;
+      const GoapState next = (node.state & ~act.effMask) | act.effValue;
+      const float cost = node.cost + act.cost;
+      auto [itf, inserted] = visited.try_emplace(next, Visit{cost, node.state, i, depth});
+      if (!inserted && itf->second.cost <= cost)
+        continue;
+      itf->second = Visit{cost, node.state, i, depth};
+      open.push(Node{cost, cost + heuristic(next, goal), next});
+    }
+  }
+  return plan; // unreachable goal, empty plan makes the agent idle
+}
+
+static bool satisfied(GoapState state, uint8_t goal)
+{
+  return (state & goals[goal].mask) == goals[goal].value;
+}
+
+static uint32_t get_plan(GoapPlanCache &cache, GoapState start, uint8_t goal)
+{
+  const uint64_t key = (uint64_t(start) << 8) | goal;
+  auto [itf, inserted] = cache.index.try_emplace(key, uint32_t(cache.plans.size()));
+  if (inserted)
+    cache.plans.push_back(find_plan(start, goals[goal]));
+  return itf->second;
+}
+
+// picks the first goal that is already reached (empty plan, agent idles) or has a plan
+static void replan(GoapPlanCache &cache, GoapAgent &agent, GoapState facts)
+{
+  for (uint8_t goal = 0; goal < GG_NUM; ++goal)
+  {
+    agent.goal = goal;
+    agent.plan = get_plan(cache, facts, goal);
+    if (satisfied(facts, goal) || !cache.plans[agent.plan].actions.empty())
+      break;
+  }
+  agent.step = 0;
+}
+
+size_t goap_cache_memory_bytes(flecs::world &ecs)
+{
+  const GoapPlanCache *cache = ecs.get<GoapPlanCache>();
+  if (!cache)
+    return 0;
+  size_t bytes = sizeof(GoapPlanCache) + heap_bytes(cache->index) + heap_bytes(cache->plans);
+  for (const GoapPlan &plan : cache->plans)
+    bytes += heap_bytes(plan.actions) + heap_bytes(plan.states);
+  return bytes;
+}
+
+void register_goap_agents(flecs::world &ecs)
+{
+  ecs.set(GoapPlanCache{});
+}
+
+void update_goap_agents(flecs::world &ecs)
+{
+  auto &agentsQuery = cached_query<struct AwakeGoapAgentsQuery>(ecs, [&]
+  {
+    return ecs.query_builder<GoapAgent, const Position, const PatrolPos, const Hitpoints, const MeleeDamage,
+                             const Team, Action>()
+      .term<Dormant>().not_()
+      .build();
+  });
+  GoapPlanCache &cache = *ecs.get_mut<GoapPlanCache>();
+  const TargetGrid &grid = *ecs.get<TargetGrid>();
+
+  agentsQuery.each([&](flecs::entity e, GoapAgent &agent, const Position &pos, const PatrolPos &ppos,
+                       const Hitpoints &hp, const MeleeDamage &dmg, const Team &team, Action &a)
+  {
+    float enemyDist = 0.f;
+    float healDist = 0.f;
+    float powerupDist = 0.f;
+    const GridEntry *enemy = find_closest_enemy(grid.actors, pos, team.team, sense_radius, enemyDist);
+    const GridEntry *heal = find_closest_pickup(grid.heals, pos, sense_radius, healDist);
+    const GridEntry *powerup = find_closest_pickup(grid.powerups, pos, sense_radius, powerupDist);
+
+    GoapState facts = 0;
+    facts |= enemy ? fact(GF_ENEMY_NEAR) : 0;
+    facts |= hp.hitpoints < low_hp ? fact(GF_LOW_HP) : 0;
+    facts |= heal ? fact(GF_HEAL_AVAILABLE) : 0;
+    facts |= powerup ? fact(GF_POWERUP_AVAILABLE) : 0;
+    facts |= dmg.damage >= powered_up_damage ? fact(GF_POWERED_UP) : 0;
+
+    if (facts != agent.facts)
+    {
+      const GoapPlan *plan = agent.plan < cache.plans.size() ? &cache.plans[agent.plan] : nullptr;
+      // the current action did what we planned for, move on without replanning
+      if (plan && agent.step < plan->states.size() && facts == plan->states[agent.step])
+        agent.step++;
+      else
+        replan(cache, agent, facts);
+      agent.facts = facts;
+    }
+
+    const GoapPlan &plan = cache.plans[agent.plan];
+    int step = agent.step < plan.actions.size() ? int(plan.actions[agent.step]) : int(GA_NUM);
+    if (step < GA_NUM && (facts & actions[step].preMask) != actions[step].preValue)
+      step = GA_NUM;
+    if (step == GA_ATTACK || step == GA_ATTACK_POWERED)
+      a.action = move_towards(pos, enemy->pos);
+    else if (step == GA_FLEE)
+      a.action = least_threat_move(ecs, team.team, pos, inverse_move(move_towards(pos, enemy->pos)));
+    else if (step == GA_GO_HEAL)
+      a.action = move_towards(pos, heal->pos);
+    else if (step == GA_GO_POWERUP)
+      a.action = move_towards(pos, powerup->pos);
+    else if (dist(pos, ppos) > patrol_dist)
+      a.action = move_towards(pos, ppos);
+    else
+      a.action = avoid_threat_move(ecs, team.team, pos, entity_rng(ecs, e).range(EA_MOVE_START, EA_MOVE_END - 1));
+  });
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <flecs.h>
+
+// Goal oriented action planning. Agent facts are a bitset, plans are found with A* over fact states
+// and cached per world by (start facts, goal), so agents in the same situation share one plan.
+// Agents only look up a new plan when their facts change in a way the current plan didn't expect.
+
+enum GoapFact : uint8_t
+{
+  GF_ENEMY_NEAR = 0,
+  GF_LOW_HP,
+  GF_HEAL_AVAILABLE,
+  GF_POWERUP_AVAILABLE,
+  GF_POWERED_UP,
+  GF_NUM
+};
+
+using GoapState = uint32_t;
+
+// in priority order, agents pick the first goal they can plan for
+enum GoapGoal : uint8_t
+{
+  GG_SURVIVE = 0,  // no enemy around and not hurt
+  GG_SAFE,         // no enemy around
+  GG_NUM
+};
+
+struct GoapAgent
+{
+  uint8_t goal = GG_NUM;   // goal of the current plan
+  GoapState facts = ~0u;   // facts the current plan was picked for, all ones forces the first lookup
+  uint32_t plan = ~0u;     // index in the world plan cache
+  uint32_t step = 0;
+};
+
+// Sets up the plan cache singleton, called on world init
+void register_goap_agents(flecs::world &ecs);
+size_t goap_cache_memory_bytes(flecs::world &ecs);
+void update_goap_agents(flecs::world &ecs);
@@ -0,0 +1,181 @@
+#include "influenceMap.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+#include "aiUtils.h"
+#include "queryCache.h"
+#include "memoryReport.h"
+
+static constexpr int chunk_shift = 4;
+static constexpr int chunk_size = 1 << chunk_shift;
+static constexpr int stamp_radius = 4;
+static constexpr int kernel_size = stamp_radius * 2 + 1;
+// stamps are added and removed in float, ignore the leftover noise when comparing cells
+static constexpr float threat_eps = 1e-3f;
+
+struct InfluenceChunk
+{
+  float cells[chunk_size * chunk_size] = {};
+};
+
+class InfluenceGrid
+{
+  std::unordered_map<uint64_t, InfluenceChunk> chunks;
+
+  static uint64_t chunk_key(int cx, int cy)
+  {
+    return uint64_t(uint32_t(cx)) | (uint64_t(uint32_t(cy)) << 32);
+  }
+public:
+  size_t heapBytes() const { return heap_bytes(chunks); }
+
+  float get(int x, int y) const
+  {
+    auto itf = chunks.find(chunk_key(x >> chunk_shift, y >> chunk_shift));
+    if (itf == chunks.end())
+      return 0.f;
+    return itf->second.cells[(x & (chunk_size - 1)) + (y & (chunk_size - 1)) * chunk_size];
+  }
+
+  // adds weights * scale centered at pos, kernel rows are split at chunk borders
+  void stamp(const Position &pos, const float *kernel, float scale)
+  {
+    for (int ky = 0; ky < kernel_size; ++ky)
+    {
+      const int y = pos.y + ky - stamp_radius;
+      for (int kx = 0; kx < kernel_size;)
+      {
+        const int x = pos.x + kx - stamp_radius;
+        InfluenceChunk &chunk = chunks[chunk_key(x >> chunk_shift, y >> chunk_shift)];
+        const int localX = x & (chunk_size - 1);
+        const int span = std::min(chunk_size - localX, kernel_size - kx);
+        float *row = chunk.cells + (y & (chunk_size - 1)) * chunk_size + localX;
+        const float *weights = kernel + ky * kernel_size + kx;
+        for (int i = 0; i < span; ++i)
+          row[i] += weights[i] * scale;
+        kx += span;
+      }
+    }
+  }
+};
+
+struct InfluenceMaps
+{
+  std::vector<InfluenceGrid> teams;
+  InfluenceGrid total;
+  float kernel[kernel_size * kernel_size] = {};
+
+  void apply(const InfluenceStamp &st, float sign)
+  {
+    if (st.team < 0)
+      return;
+    if (size_t(st.team) >= teams.size())
+      teams.resize(size_t(st.team) + 1);
+    teams[size_t(st.team)].stamp(st.pos, kernel, st.strength * sign);
+    total.stamp(st.pos, kernel, st.strength * sign);
+  }
+};
+
+static InfluenceMaps *get_maps(flecs::world ecs)
+{
+  // the observer also fires on world teardown, don't recreate the singleton then
+  return ecs.has<InfluenceMaps>() ? ecs.get_mut<InfluenceMaps>() : nullptr;
+}
+
+size_t influence_maps_memory_bytes(flecs::world &ecs)
+{
+  const InfluenceMaps *maps = ecs.get<InfluenceMaps>();
+  if (!maps)
+    return 0;
+  size_t bytes = sizeof(InfluenceMaps) + heap_bytes(maps->teams) + maps->total.heapBytes();
+  for (const InfluenceGrid &grid : maps->teams)
+    bytes += grid.heapBytes();
+  return bytes;
+}
+
+void register_influence_maps(flecs::world &ecs)
+{
+  InfluenceMaps initial;
+  for (int y = 0; y < kernel_size; ++y)
+    for (int x = 0; x < kernel_size; ++x)
+    {
+      const float d = sqrtf(float(sqr(x - stamp_radius) + sqr(y - stamp_radius)));
+      initial.kernel[y * kernel_size + x] = std::max(0.f, 1.f - d / float(stamp_radius + 1));
+    }
+  ecs.set(std::move(initial));
+
+  // covers deaths, pickups of the stamp and snapshot reloads
+  ecs.observer<const InfluenceStamp>()
+    .event(flecs::OnRemove)
+    .each([](flecs::entity e, const InfluenceStamp &st)
+    {
+      InfluenceMaps *maps = get_maps(e.world());
+      if (maps && st.stamped)
+        maps->apply(st, -1.f);
+    });
+}
+
+void update_influence_maps(flecs::world &ecs)
+{
+  auto &stampedQuery = cached_query<const Position, const Team, const MeleeDamage, InfluenceStamp>(ecs);
+  auto &unstampedQuery = cached_query<struct UnstampedInfluenceQuery>(ecs, [&]
+  {
+    return ecs.query_builder<const Position, const Team, const MeleeDamage>()
+      .term<InfluenceStamp>().not_()
+      .build();
+  });
+  InfluenceMaps &maps = *ecs.get_mut<InfluenceMaps>();
+
+  stampedQuery.each([&](const Position &pos, const Team &team, const MeleeDamage &dmg, InfluenceStamp &st)
+  {
+    if (st.stamped && st.pos == pos && st.team == team.team && st.strength == dmg.damage)
+      return;
+    if (st.stamped)
+      maps.apply(st, -1.f);
+    st = InfluenceStamp{pos, dmg.damage, team.team, true};
+    maps.apply(st, 1.f);
+  });
+
+  ecs.defer([&]
+  {
+    unstampedQuery.each([&](flecs::entity e, const Position &pos, const Team &team, const MeleeDamage &dmg)
+    {
+      const InfluenceStamp st{pos, dmg.damage, team.team, true};
+      maps.apply(st, 1.f);
+      e.set(st);
+    });
+  });
+}
+
+float get_threat(const flecs::world &ecs, int team, const Position &pos)
+{
+  const InfluenceMaps *maps = ecs.get<InfluenceMaps>();
+  if (!maps)
+    return 0.f;
+  const float own = team >= 0 && size_t(team) < maps->teams.size() ? maps->teams[size_t(team)].get(pos.x, pos.y) : 0.f;
+  return maps->total.get(pos.x, pos.y) - own;
+}
+
+int least_threat_move(const flecs::world &ecs, int team, const Position &pos, int fallback_move)
+{
+  int bestMove = fallback_move;
+  float bestThreat = get_threat(ecs, team, move_pos(pos, fallback_move));
+  for (int move = EA_MOVE_START; move < EA_MOVE_END; ++move)
+  {
+    const float threat = get_threat(ecs, team, move_pos(pos, move));
+    if (threat < bestThreat - threat_eps)
+    {
+      bestThreat = threat;
+      bestMove = move;
+    }
+  }
+  return bestMove;
+}
+
+int avoid_threat_move(const flecs::world &ecs, int team, const Position &pos, int move)
+{
+  if (get_threat(ecs, team, move_pos(pos, move)) <= get_threat(ecs, team, pos) + threat_eps)
+    return move;
+  return least_threat_move(ecs, team, pos, move);
+}
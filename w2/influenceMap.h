@@ -0,0 +1,28 @@
+#pragma once
+#include <flecs.h>
+#include "ecsTypes.h"
+
+// Per-team threat grids. Every actor with MeleeDamage stamps a small falloff kernel scaled by its
+// damage into its team grid and into a total grid, so threat against a team is total - own team.
+// Grids are sparse 16x16 chunks. Stamps are only redone when an actor moved or its damage changed,
+// and removed when the actor dies or loses its stamp.
+
+// what an entity currently contributes, used to remove exactly that on change
+struct InfluenceStamp
+{
+  Position pos;
+  float strength = 0.f;
+  int team = 0;
+  bool stamped = false;
+};
+
+void register_influence_maps(flecs::world &ecs);
+size_t influence_maps_memory_bytes(flecs::world &ecs);
+// restamps actors changed since the last call, cheap when few of them moved
+void update_influence_maps(flecs::world &ecs);
+
+float get_threat(const flecs::world &ecs, int team, const Position &pos);
+// move to the neighbouring cell with the least threat against team, prefers fallback_move on ties
+int least_threat_move(const flecs::world &ecs, int team, const Position &pos, int fallback_move);
+// keeps move unless it steps into more threat than standing still, then takes the least threatening one
+int avoid_threat_move(const flecs::world &ecs, int team, const Position &pos, int move);
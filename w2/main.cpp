@@ -4,10 +4,22 @@
 #include <flecs.h>
 #include "ecsTypes.h"
 #include "roguelike.h"
+#include "aiProfiler.h"
+#include "replay.h"
+#include "worldSnapshot.h"
+#include "behBench.h"
+#include "batchRunner.h"
+#include "memoryReport.h"
+#include "spatialSort.h"
+#include "chunkStreaming.h"
+#include "queryCache.h"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 
 static void update_camera(Camera2D &cam, flecs::world &ecs)
 {
-  static auto playerQuery = ecs.query<const Position, const IsPlayer>();
+  auto &playerQuery = cached_query<const Position, const IsPlayer>(ecs);
 
   playerQuery.each([&](const Position &pos, const IsPlayer &)
   {
@@ -16,15 +28,96 @@ static void update_camera(Camera2D &cam, flecs::world &ecs)
   });
 }
 
-int main(int /*argc*/, const char ** /*argv*/)
+int main(int argc, const char **argv)
 {
+  const char *recordPath = nullptr;
+  const char *snapshotPath = nullptr;
+  const char *scenarioPath = nullptr;
+  uint64_t seed = uint64_t(time(nullptr));
+  BatchConfig batch;
+  bool runBatch = false;
+  bool memoryReportOnly = false;
+  int streamRadius = 0;
+  const char *streamDir = "chunks";
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+      return play_replay(argv[i + 1]) ? 0 : 1;
+    else if (!strcmp(argv[i], "--bench-bt") && i + 1 < argc)
+      return run_bt_benchmark(atoi(argv[i + 1]), i + 2 < argc ? atoi(argv[i + 2]) : 100);
+    else if (!strcmp(argv[i], "--bench-spatial") && i + 1 < argc)
+      return run_spatial_sort_benchmark(atoi(argv[i + 1]));
+    else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+      recordPath = argv[++i];
+    else if (!strcmp(argv[i], "--scenario") && i + 1 < argc)
+      scenarioPath = argv[++i];
+    else if (!strcmp(argv[i], "--load") && i + 1 < argc)
+      snapshotPath = argv[++i];
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+      seed = strtoull(argv[++i], nullptr, 10);
+    else if (!strcmp(argv[i], "--batch") && i + 1 < argc)
+    {
+      runBatch = true;
+      batch.matchesPerSetup = atoi(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+      batch.threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--out") && i + 1 < argc)
+      batch.outPath = argv[++i];
+    else if (!strcmp(argv[i], "--max-turns") && i + 1 < argc)
+      batch.maxTurns = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--memory-report"))
+      memoryReportOnly = true;
+    else if (!strcmp(argv[i], "--stream-radius") && i + 1 < argc)
+      streamRadius = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--stream-dir") && i + 1 < argc)
+      streamDir = argv[++i];
+  }
+  if (runBatch)
+  {
+    batch.seed = seed;
+    return run_batch(batch);
+  }
+  if (memoryReportOnly)
+  {
+    // sizes a scenario without opening a window
+    flecs::world ecs;
+    ecs.set(WorldSeed{seed});
+    if (!init_roguelike(ecs, true, scenarioPath) || (snapshotPath && !load_world_snapshot(ecs, snapshotPath)))
+      return 1;
+    print_memory_report(ecs, stdout);
+    return 0;
+  }
+
   int width = 1920;
   int height = 1080;
   InitWindow(width, height, "w2 AI MIPT");
 
   flecs::world ecs;
 
-  init_roguelike(ecs);
+  // scenarios place entities using the world seed
+  ecs.set(WorldSeed{seed});
+  if (!init_roguelike(ecs, false, scenarioPath))
+  {
+    CloseWindow();
+    return 1;
+  }
+  if (snapshotPath && !load_world_snapshot(ecs, snapshotPath))
+    fprintf(stderr, "cannot load world snapshot '%s'\n", snapshotPath);
+  if (streamRadius > 0)
+    enable_chunk_streaming(ecs, streamRadius, streamDir);
+
+  ReplayWriter replay;
+  // replays start from the scenario, a snapshot or streamed chunks would respawn entities under other ids
+  if (recordPath && (snapshotPath || streamRadius > 0))
+    fprintf(stderr, "recording is not supported with --load or --stream-radius, not recording\n");
+  else if (recordPath)
+  {
+    if (replay.open(recordPath, seed, scenarioPath))
+      ecs.set(TurnLog{});
+    else
+      fprintf(stderr, "cannot open '%s' for recording\n", recordPath);
+  }
 
   Camera2D camera = { {0, 0}, {0, 0}, 0.f, 1.f };
   camera.target = Vector2{ 0.f, 0.f };
@@ -33,14 +126,41 @@ int main(int /*argc*/, const char ** /*argv*/)
   camera.zoom = 64.f;
 
   SetTargetFPS(60);               // Set our game to run at 60 frames-per-second
+  const char *quickSavePath = "world.snapshot";
   while (!WindowShouldClose())
   {
-    process_turn(ecs);
+    // evicted chunks are brought back first, far ones are evicted again on the next turn
+    if (IsKeyPressed(KEY_F5))
+    {
+      load_streamed_chunks(ecs);
+      if (!save_world_snapshot(ecs, quickSavePath))
+        fprintf(stderr, "cannot save world snapshot '%s'\n", quickSavePath);
+    }
+    if (IsKeyPressed(KEY_F9))
+    {
+      // walls of chunks evicted since the save come back, their entities are replaced by the snapshot ones
+      load_streamed_chunks(ecs);
+      if (!load_world_snapshot(ecs, quickSavePath))
+        fprintf(stderr, "cannot load world snapshot '%s'\n", quickSavePath);
+      else
+      {
+        if (replay.isOpen())
+        {
+          fprintf(stderr, "world loaded from a snapshot, recording stopped\n");
+          replay.close();
+        }
+      }
+    }
+    if (IsKeyPressed(KEY_F7))
+      print_memory_report(ecs, stdout);
+    if (process_turn(ecs) && replay.isOpen())
+      replay.writeTurn(*ecs.get<TurnLog>());
     update_camera(camera, ecs);
 
     BeginDrawing();
       ClearBackground(GetColor(0x052c46ff));
       BeginMode2D(camera);
+        draw_dungeon(ecs);
         ecs.progress();
       EndMode2D();
       print_stats(ecs);
@@ -48,7 +168,10 @@ int main(int /*argc*/, const char ** /*argv*/)
     EndDrawing();
   }
 
+  print_memory_report(ecs, stdout);
   CloseWindow();
 
+  ai_profiler_report(stdout, 20);
+
   return 0;
 }
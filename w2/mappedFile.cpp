@@ -0,0 +1,101 @@
+#include "mappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *path)
+{
+  close();
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  fileHandle = file;
+  mappingHandle = mapping;
+  ptr = static_cast<const uint8_t*>(view);
+  len = size_t(fileSize.QuadPart);
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (ptr)
+    UnmapViewOfFile(ptr);
+  if (mappingHandle)
+    CloseHandle(mappingHandle);
+  if (fileHandle)
+    CloseHandle(fileHandle);
+  ptr = nullptr;
+  len = 0;
+  fileHandle = nullptr;
+  mappingHandle = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const char *path)
+{
+  close();
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  void *view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  // mapping stays valid after the descriptor is closed
+  ::close(fd);
+  if (view == MAP_FAILED)
+    return false;
+  // we stream through the file once while loading
+  madvise(view, size_t(st.st_size), MADV_SEQUENTIAL);
+  ptr = static_cast<const uint8_t*>(view);
+  len = size_t(st.st_size);
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (ptr)
+    munmap(const_cast<uint8_t*>(ptr), len);
+  ptr = nullptr;
+  len = 0;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+  const uint8_t *ptr = nullptr;
+  size_t len = 0;
+#ifdef _WIN32
+  void *fileHandle = nullptr;
+  void *mappingHandle = nullptr;
+#endif
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  bool open(const char *path);
+  void close();
+
+  const uint8_t *data() const { return ptr; }
+  size_t size() const { return len; }
+};
@@ -0,0 +1,539 @@
+#include "mcts.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ecsTypes.h"
+#include "aiUtils.h"
+#include "rng.h"
+#include "dungeonMap.h"
+#include "queryCache.h"
+#include "memoryReport.h"
+
+static constexpr int mcts_num_actions = EA_MOVE_END; // nop and four moves, indexed by action
+static constexpr int mcts_max_depth = 255;
+static constexpr float mcts_exploration = 0.7f;
+static constexpr int policy_sense_dist = 8;
+
+void sim_turn(SimState &state, const int *actions)
+{
+  const bool npcTurn = state.clock == 0;
+  int moveX[sim_max_actors];
+  int moveY[sim_max_actors];
+  bool killed[sim_max_actors] = {};
+  std::copy_n(state.actorX, state.numActors, moveX);
+  std::copy_n(state.actorY, state.numActors, moveY);
+
+  // same order of resolution as process_actions: earlier actors claim cells first,
+  // actors killed this turn still block and act until the end of it
+  for (int i = 0; i < state.numActors; ++i)
+  {
+    if (!state.actorPresent[i])
+      continue;
+    const int action = state.actorPlayer[i] || npcTurn ? actions[i] : EA_NOP;
+    const Position next = move_pos(Position{state.actorX[i], state.actorY[i]}, action);
+    bool blocked = state.isWall(next.x, next.y);
+    for (int j = 0; j < state.numActors; ++j)
+    {
+      if (j == i || !state.actorPresent[j] || moveX[j] != next.x || moveY[j] != next.y)
+        continue;
+      blocked = true;
+      if (state.actorTeam[i] != state.actorTeam[j])
+      {
+        const bool wasAlive = state.actorHp[j] > 0.f;
+        state.actorHp[j] -= state.actorDamage[i];
+        if (wasAlive && state.actorHp[j] <= 0.f)
+          killed[j] = true;
+      }
+    }
+    if (!blocked)
+    {
+      moveX[i] = next.x;
+      moveY[i] = next.y;
+    }
+  }
+
+  for (int i = 0; i < state.numActors; ++i)
+  {
+    state.actorX[i] = moveX[i];
+    state.actorY[i] = moveY[i];
+    if (killed[i])
+      state.actorPresent[i] = false;
+  }
+
+  for (int i = 0; i < state.numActors; ++i)
+  {
+    if (!state.actorPresent[i] || !state.actorCanPickup[i])
+      continue;
+    for (int p = 0; p < state.numPickups; ++p)
+    {
+      if (!state.pickupPresent[p] || state.pickupX[p] != state.actorX[i] || state.pickupY[p] != state.actorY[i])
+        continue;
+      state.actorHp[i] += state.pickupHeal[p];
+      state.actorDamage[i] += state.pickupPower[p];
+      state.pickupPresent[p] = false;
+    }
+  }
+
+  state.clock = (state.clock + 1) % state.clockPeriod;
+}
+
+// Rollout policy: mostly step towards the closest enemy in sight, wander otherwise
+static int default_policy(const SimState &state, int idx, CounterRng &rng)
+{
+  int closest = -1;
+  int closestDist = policy_sense_dist + 1;
+  for (int j = 0; j < state.numActors; ++j)
+  {
+    if (!state.actorPresent[j] || state.actorTeam[j] == state.actorTeam[idx])
+      continue;
+    const int d = abs(state.actorX[j] - state.actorX[idx]) + abs(state.actorY[j] - state.actorY[idx]);
+    if (d < closestDist)
+    {
+      closestDist = d;
+      closest = j;
+    }
+  }
+  if (closest >= 0 && rng.uniform() < 0.8f)
+    return move_towards(Position{state.actorX[idx], state.actorY[idx]}, Position{state.actorX[closest], state.actorY[closest]});
+  return rng.range(EA_MOVE_START, EA_MOVE_END - 1);
+}
+
+// Plays turns until actor 0 acts (every turn for the player, npc turns otherwise)
+static void advance(SimState &state, int action, CounterRng &rng)
+{
+  int actions[sim_max_actors];
+  for (int turn = 0; turn < state.clockPeriod; ++turn)
+  {
+    const bool npcTurn = state.clock == 0;
+    const bool agentActs = state.actorPlayer[0] || npcTurn;
+    for (int i = 1; i < state.numActors; ++i)
+    {
+      if (state.hasPending)
+        actions[i] = state.actorPending[i];
+      else
+        actions[i] = state.actorPresent[i] && (state.actorPlayer[i] || npcTurn) ? default_policy(state, i, rng) : EA_NOP;
+    }
+    actions[0] = agentActs ? action : EA_NOP;
+    state.hasPending = false;
+    sim_turn(state, actions);
+    if (agentActs)
+      return;
+  }
+}
+
+// [0, 1], half for own hitpoints kept, half for damage done to enemies
+static float evaluate(const SimState &state)
+{
+  const float own = state.actorPresent[0] ? std::clamp(state.actorHp[0] / state.actorMaxHp[0], 0.f, 1.f) : 0.f;
+  float enemyLoss = 0.f;
+  int enemies = 0;
+  for (int i = 1; i < state.numActors; ++i)
+  {
+    if (state.actorTeam[i] == state.actorTeam[0])
+      continue;
+    enemies++;
+    enemyLoss += state.actorPresent[i] ? 1.f - std::clamp(state.actorHp[i] / state.actorMaxHp[i], 0.f, 1.f) : 1.f;
+  }
+  return 0.5f * own + (enemies > 0 ? 0.5f * enemyLoss / float(enemies) : 0.f);
+}
+
+struct MctsNode
+{
+  float value = 0.f;
+  uint32_t visits = 0;
+  int32_t children[mcts_num_actions] = {-1, -1, -1, -1, -1};
+};
+
+// Nodes are kept between searches, so once grown to the iteration count searches don't allocate
+class MctsTree
+{
+  std::vector<MctsNode> nodes;
+public:
+  size_t heapBytes() const { return heap_bytes(nodes); }
+private:
+
+  int selectChild(const MctsNode &node) const
+  {
+    const float logVisits = logf(float(node.visits));
+    int best = EA_NOP;
+    float bestScore = -1.f;
+    for (int act = 0; act < mcts_num_actions; ++act)
+    {
+      const MctsNode &child = nodes[size_t(node.children[act])];
+      const float score = child.value / float(child.visits) + mcts_exploration * sqrtf(logVisits / float(child.visits));
+      if (score > bestScore)
+      {
+        bestScore = score;
+        best = act;
+      }
+    }
+    return best;
+  }
+
+public:
+  int search(const SimState &root, const MctsAgent &agent, uint64_t seed)
+  {
+    const int depth = std::min(int(agent.depth), mcts_max_depth);
+    nodes.clear();
+    nodes.reserve(size_t(agent.iterations) + 1);
+    nodes.emplace_back();
+    CounterRng rng(seed, 0, 0);
+    int32_t path[mcts_max_depth + 1];
+    for (int it = 0; it < agent.iterations; ++it)
+    {
+      SimState sim = root;
+      int32_t node = 0;
+      int pathLen = 0;
+      path[pathLen++] = node;
+      int turns = 0;
+      // walk down the tree while fully expanded, then expand one untried action
+      for (; turns < depth && sim.actorPresent[0]; ++turns)
+      {
+        int untried = -1;
+        const int start = rng.range(0, mcts_num_actions - 1);
+        for (int k = 0; k < mcts_num_actions && untried < 0; ++k)
+          if (nodes[size_t(node)].children[(start + k) % mcts_num_actions] < 0)
+            untried = (start + k) % mcts_num_actions;
+        if (untried >= 0)
+        {
+          const int32_t child = int32_t(nodes.size());
+          nodes.emplace_back();
+          nodes[size_t(node)].children[untried] = child;
+          advance(sim, untried, rng);
+          path[pathLen++] = child;
+          ++turns;
+          break;
+        }
+        const int act = selectChild(nodes[size_t(node)]);
+        advance(sim, act, rng);
+        node = nodes[size_t(node)].children[act];
+        path[pathLen++] = node;
+      }
+      for (; turns < depth && sim.actorPresent[0]; ++turns)
+        advance(sim, default_policy(sim, 0, rng), rng);
+
+      const float value = evaluate(sim);
+      for (int i = 0; i < pathLen; ++i)
+      {
+        nodes[size_t(path[i])].visits++;
+        nodes[size_t(path[i])].value += value;
+      }
+    }
+
+    int best = EA_NOP;
+    uint32_t bestVisits = 0;
+    for (int act = 0; act < mcts_num_actions; ++act)
+    {
+      const int32_t child = nodes[0].children[act];
+      if (child >= 0 && nodes[size_t(child)].visits > bestVisits)
+      {
+        bestVisits = nodes[size_t(child)].visits;
+        best = act;
+      }
+    }
+    return best;
+  }
+};
+
+struct GatheredActor
+{
+  flecs::entity_t eid;
+  Position pos;
+  float hitpoints;
+  float damage;
+  int team;
+  int action;
+  bool player;
+  bool canPickup;
+};
+
+struct GatheredPickup
+{
+  Position pos;
+  float heal;
+  float power;
+};
+
+struct MctsJob
+{
+  SimState state;
+  MctsAgent agent;
+  uint64_t seed;
+  Action *action;
+};
+
+// Search threads living as long as the world. run() hands every worker the same work and blocks
+// until all of them are done, the calling thread works as index 0 meanwhile.
+class MctsWorkerPool
+{
+public:
+  explicit MctsWorkerPool(size_t num_workers)
+  {
+    workers.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i)
+      workers.emplace_back([this, i] { workerLoop(i + 1); });
+  }
+
+  ~MctsWorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : workers)
+      t.join();
+  }
+
+  size_t numThreads() const { return workers.size() + 1; }
+
+  template<typename Work>
+  void run(Work &work)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      fn = [](void *context, size_t thread_idx) { (*static_cast<Work*>(context))(thread_idx); };
+      ctx = &work;
+      pending = workers.size();
+      generation++;
+    }
+    wake.notify_all();
+    work(size_t(0));
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending == 0; });
+  }
+
+private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  void (*fn)(void *, size_t) = nullptr;
+  void *ctx = nullptr;
+  uint64_t generation = 0;
+  size_t pending = 0;
+  bool quit = false;
+
+  void workerLoop(size_t thread_idx)
+  {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+      wake.wait(lock, [&] { return quit || generation != seen; });
+      if (quit)
+        return;
+      seen = generation;
+      void (*curFn)(void *, size_t) = fn;
+      void *curCtx = ctx;
+      lock.unlock();
+      curFn(curCtx, thread_idx);
+      lock.lock();
+      if (--pending == 0)
+        done.notify_one();
+    }
+  }
+};
+
+// World singleton, reused between turns
+struct MctsScratch
+{
+  std::vector<GatheredActor> actors;
+  std::vector<GatheredPickup> pickups;
+  std::vector<std::pair<int, size_t>> candidates;
+  std::vector<MctsJob> jobs;
+  std::vector<MctsTree> trees;
+  std::unique_ptr<MctsWorkerPool> pool; // created on first search, rebuilt if MctsSettings change
+  int clockPeriod = 1;
+};
+
+static void gather(flecs::world &ecs, MctsScratch &scratch)
+{
+  auto &actorsQuery = cached_query<const Position, const Hitpoints, const MeleeDamage, const Team, const Action>(ecs);
+  auto &healsQuery = cached_query<const Position, const HealAmount>(ecs);
+  auto &powerupsQuery = cached_query<const Position, const PowerupAmount>(ecs);
+  auto &playerQuery = cached_query<const IsPlayer, const NumActions>(ecs);
+
+  scratch.actors.clear();
+  actorsQuery.each([&](flecs::entity e, const Position &pos, const Hitpoints &hp, const MeleeDamage &dmg,
+                       const Team &team, const Action &a)
+  {
+    scratch.actors.push_back(GatheredActor{e.id(), pos, hp.hitpoints, dmg.damage, team.team, a.action,
+                                           e.has<IsPlayer>(), e.has<CanPickup>()});
+  });
+  scratch.pickups.clear();
+  healsQuery.each([&](const Position &pos, const HealAmount &heal)
+  {
+    scratch.pickups.push_back(GatheredPickup{pos, heal.amount, 0.f});
+  });
+  powerupsQuery.each([&](const Position &pos, const PowerupAmount &power)
+  {
+    scratch.pickups.push_back(GatheredPickup{pos, 0.f, power.amount});
+  });
+  scratch.clockPeriod = 1;
+  playerQuery.each([&](const IsPlayer, const NumActions &na)
+  {
+    scratch.clockPeriod = std::max(na.numActions, 1);
+  });
+}
+
+static bool in_window(const SimState &state, const Position &pos)
+{
+  return pos.x >= state.originX && pos.y >= state.originY &&
+         pos.x < state.originX + sim_map_size && pos.y < state.originY + sim_map_size;
+}
+
+// the agent goes first, then the closest actors and pickups inside the window
+static void fill_sim_state(const DungeonMap *map, MctsScratch &scratch, size_t agent_idx, SimState &state)
+{
+  const GatheredActor &agent = scratch.actors[agent_idx];
+  state = SimState{};
+  state.originX = agent.pos.x - sim_map_size / 2;
+  state.originY = agent.pos.y - sim_map_size / 2;
+  if (map)
+    for (int y = 0; y < sim_map_size; ++y)
+      for (int x = 0; x < sim_map_size; ++x)
+        if (map->isWall(state.originX + x, state.originY + y))
+          state.walls[y] |= 1u << x;
+  state.clock = 0;
+  state.clockPeriod = scratch.clockPeriod;
+  state.hasPending = true;
+
+  auto addActor = [&](const GatheredActor &a)
+  {
+    const int i = state.numActors++;
+    state.actorX[i] = a.pos.x;
+    state.actorY[i] = a.pos.y;
+    state.actorHp[i] = a.hitpoints;
+    state.actorMaxHp[i] = std::max(a.hitpoints, 1.f);
+    state.actorDamage[i] = a.damage;
+    state.actorTeam[i] = a.team;
+    state.actorPending[i] = uint8_t(a.action);
+    state.actorPresent[i] = true;
+    state.actorPlayer[i] = a.player;
+    state.actorCanPickup[i] = a.canPickup;
+  };
+  addActor(agent);
+
+  auto &candidates = scratch.candidates;
+  candidates.clear();
+  for (size_t i = 0; i < scratch.actors.size(); ++i)
+    if (i != agent_idx && in_window(state, scratch.actors[i].pos))
+      candidates.emplace_back(abs(scratch.actors[i].pos.x - agent.pos.x) + abs(scratch.actors[i].pos.y - agent.pos.y), i);
+  const size_t numActors = std::min(candidates.size(), size_t(sim_max_actors - 1));
+  std::partial_sort(candidates.begin(), candidates.begin() + ptrdiff_t(numActors), candidates.end());
+  for (size_t i = 0; i < numActors; ++i)
+    addActor(scratch.actors[candidates[i].second]);
+
+  candidates.clear();
+  for (size_t i = 0; i < scratch.pickups.size(); ++i)
+    if (in_window(state, scratch.pickups[i].pos))
+      candidates.emplace_back(abs(scratch.pickups[i].pos.x - agent.pos.x) + abs(scratch.pickups[i].pos.y - agent.pos.y), i);
+  const size_t numPickups = std::min(candidates.size(), size_t(sim_max_pickups));
+  std::partial_sort(candidates.begin(), candidates.begin() + ptrdiff_t(numPickups), candidates.end());
+  for (size_t i = 0; i < numPickups; ++i)
+  {
+    const GatheredPickup &p = scratch.pickups[candidates[i].second];
+    const int idx = state.numPickups++;
+    state.pickupX[idx] = p.pos.x;
+    state.pickupY[idx] = p.pos.y;
+    state.pickupHeal[idx] = p.heal;
+    state.pickupPower[idx] = p.power;
+    state.pickupPresent[idx] = true;
+  }
+}
+
+void capture_sim_state(flecs::world &ecs, flecs::entity agent, SimState &state)
+{
+  MctsScratch scratch;
+  gather(ecs, scratch);
+  state = SimState{};
+  for (size_t i = 0; i < scratch.actors.size(); ++i)
+    if (scratch.actors[i].eid == agent.id())
+      fill_sim_state(ecs.get<DungeonMap>(), scratch, i, state);
+}
+
+int mcts_search(const SimState &root, const MctsAgent &agent, uint64_t seed)
+{
+  thread_local MctsTree tree;
+  return tree.search(root, agent, seed);
+}
+
+size_t mcts_scratch_memory_bytes(flecs::world &ecs)
+{
+  const MctsScratch *scratch = ecs.get<MctsScratch>();
+  if (!scratch)
+    return 0;
+  size_t bytes = sizeof(MctsScratch) + heap_bytes(scratch->actors) + heap_bytes(scratch->pickups) +
+                 heap_bytes(scratch->candidates) + heap_bytes(scratch->jobs) + heap_bytes(scratch->trees);
+  for (const MctsTree &tree : scratch->trees)
+    bytes += tree.heapBytes();
+  if (scratch->pool)
+    bytes += sizeof(MctsWorkerPool) + (scratch->pool->numThreads() - 1) * sizeof(std::thread);
+  return bytes;
+}
+
+void register_mcts_agents(flecs::world &ecs)
+{
+  ecs.set(MctsScratch{});
+}
+
+void update_mcts_agents(flecs::world &ecs)
+{
+  auto &agentsQuery = cached_query<struct AwakeMctsAgentsQuery>(ecs, [&]
+  {
+    return ecs.query_builder<const MctsAgent, Action>()
+      .term<Dormant>().not_()
+      .build();
+  });
+  if (ecs.count<MctsAgent>() == 0)
+    return;
+  MctsScratch &scratch = *ecs.get_mut<MctsScratch>();
+  gather(ecs, scratch);
+
+  const DungeonMap *map = ecs.get<DungeonMap>();
+  size_t numJobs = 0;
+  agentsQuery.each([&](flecs::entity e, const MctsAgent &agent, Action &a)
+  {
+    const auto itf = std::find_if(scratch.actors.begin(), scratch.actors.end(),
+                                  [&](const GatheredActor &actor) { return actor.eid == e.id(); });
+    if (itf == scratch.actors.end())
+      return;
+    if (numJobs == scratch.jobs.size())
+      scratch.jobs.emplace_back();
+    MctsJob &job = scratch.jobs[numJobs++];
+    fill_sim_state(map, scratch, size_t(itf - scratch.actors.begin()), job.state);
+    job.agent = agent;
+    job.seed = entity_rng(ecs, e).next();
+    job.action = &a;
+  });
+
+  // jobs only read their own state and write their own Action, the world isn't touched meanwhile
+  const MctsSettings *settings = ecs.get<MctsSettings>();
+  const size_t wantThreads = settings && settings->threads > 0 ? size_t(settings->threads)
+                                                                : std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+  if (!scratch.pool || scratch.pool->numThreads() != wantThreads)
+    scratch.pool = std::make_unique<MctsWorkerPool>(wantThreads - 1);
+  if (scratch.trees.size() < wantThreads)
+    scratch.trees.resize(wantThreads);
+  std::atomic<size_t> nextJob{0};
+  auto worker = [&](size_t thread_idx)
+  {
+    for (size_t i; (i = nextJob.fetch_add(1, std::memory_order_relaxed)) < numJobs;)
+    {
+      const MctsJob &job = scratch.jobs[i];
+      job.action->action = scratch.trees[thread_idx].search(job.state, job.agent, job.seed);
+    }
+  };
+  // a single job doesn't need to wake anyone
+  if (numJobs > 1)
+    scratch.pool->run(worker);
+  else
+    worker(size_t(0));
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <flecs.h>
+
+// Monte Carlo tree search over a compact mirror of the game state around an agent. Rollouts never
+// touch the world: SimState is a fixed size block of plain arrays (no pointers, no heap), so a copy
+// is a memcpy of under a kilobyte, and sim_turn replays the rules of process_actions on it
+// (walls, blocking, melee, deaths, heals and powerups, npcs acting every player NumActions turns).
+// Search trees live in per-thread scratch sized once, agents are searched in parallel by worker
+// threads that live as long as the world.
+
+static constexpr int sim_max_actors = 16;
+static constexpr int sim_max_pickups = 16;
+static constexpr int sim_map_size = 32; // walls around the agent, one bit per cell, outside is open
+
+struct SimState
+{
+  int originX = 0;
+  int originY = 0;
+  uint32_t walls[sim_map_size] = {};
+
+  // clock mirrors the player's NumActions: npcs act only on turns when it's 0
+  int clock = 0;
+  int clockPeriod = 1;
+  bool hasPending = false; // actions of the turn being planned are already known
+
+  int numActors = 0;
+  int actorX[sim_max_actors] = {};
+  int actorY[sim_max_actors] = {};
+  float actorHp[sim_max_actors] = {};
+  float actorMaxHp[sim_max_actors] = {};
+  float actorDamage[sim_max_actors] = {};
+  int actorTeam[sim_max_actors] = {};
+  uint8_t actorPending[sim_max_actors] = {};
+  bool actorPresent[sim_max_actors] = {};
+  bool actorPlayer[sim_max_actors] = {};
+  bool actorCanPickup[sim_max_actors] = {};
+
+  int numPickups = 0;
+  int pickupX[sim_max_pickups] = {};
+  int pickupY[sim_max_pickups] = {};
+  float pickupHeal[sim_max_pickups] = {};
+  float pickupPower[sim_max_pickups] = {};
+  bool pickupPresent[sim_max_pickups] = {};
+
+  bool isWall(int x, int y) const
+  {
+    const int lx = x - originX;
+    const int ly = y - originY;
+    if (lx < 0 || ly < 0 || lx >= sim_map_size || ly >= sim_map_size)
+      return false;
+    return (walls[ly] >> lx) & 1u;
+  }
+};
+
+// Resolves one turn, actions are indexed like actors. Npc actions are ignored when the clock says
+// it's not their turn, as process_turn doesn't plan them then.
+void sim_turn(SimState &state, const int *actions);
+
+struct MctsAgent
+{
+  uint16_t iterations = 256;
+  uint8_t depth = 8; // rollout length in the agent's own turns
+};
+
+// Optional world singleton, threads used to search agents, 0 picks hardware concurrency
+struct MctsSettings
+{
+  int threads = 0;
+};
+
+// Mirrors the world around agent (always actor 0) as of npc planning: the current turn is an npc
+// turn and Actions already planned by other agents are kept for it.
+void capture_sim_state(flecs::world &ecs, flecs::entity agent, SimState &state);
+// Picks the action for actor 0, seed makes the search reproducible
+int mcts_search(const SimState &root, const MctsAgent &agent, uint64_t seed);
+
+// Sets up the search scratch singleton, called on world init
+void register_mcts_agents(flecs::world &ecs);
+// search trees and gathered state, thread stacks of the pool aren't included
+size_t mcts_scratch_memory_bytes(flecs::world &ecs);
+// Searches all MctsAgent entities and writes the chosen Action
+void update_mcts_agents(flecs::world &ecs);
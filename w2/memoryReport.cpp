@@ -0,0 +1,263 @@
+#include "memoryReport.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "raylib.h"
+#include "ecsTypes.h"
+#include "stateMachine.h"
+#include "behaviourTree.h"
+#include "behCoroutine.h"
+#include "blackboard.h"
+#include "aiArchetypes.h"
+#include "influenceMap.h"
+#include "fov.h"
+#include "utilityAi.h"
+#include "goap.h"
+#include "targetGrid.h"
+#include "mcts.h"
+#include "queryCache.h"
+#include "dungeonMap.h"
+#include "pickups.h"
+#include "roguelike.h"
+#include "chunkStreaming.h"
+#include "replay.h"
+#include "dormancy.h"
+
+// entity id in its table plus its entity index record, an estimate of flecs internals
+static constexpr size_t flecs_entity_overhead = sizeof(flecs::entity_t) + 24;
+
+struct SingletonInfo
+{
+  const char *name;
+  size_t (*bytes)(flecs::world &ecs);
+};
+
+static const SingletonInfo singletons[] =
+{
+  {"DungeonMap", [](flecs::world &ecs)
+    {
+      const DungeonMap *map = ecs.get<DungeonMap>();
+      return map ? sizeof(DungeonMap) + map->heapBytes() : size_t(0);
+    }},
+  {"InfluenceMaps", influence_maps_memory_bytes},
+  {"PickupIndex", pickup_index_memory_bytes},
+  {"WakeIndex", wake_index_memory_bytes},
+  {"KillList, CombatScratch", turn_scratch_memory_bytes},
+  {"UtilityScratch", utility_scratch_memory_bytes},
+  {"TargetGrid", target_grid_memory_bytes},
+  {"GoapPlanCache", goap_cache_memory_bytes},
+  {"MctsScratch", mcts_scratch_memory_bytes},
+  {"ChunkStreaming", chunk_streaming_memory_bytes},
+  {"TurnLog", [](flecs::world &ecs)
+    {
+      const TurnLog *log = ecs.get<TurnLog>();
+      return log ? sizeof(TurnLog) + heap_bytes(log->actions) : size_t(0);
+    }},
+  {"QueryCache", [](flecs::world &ecs) { return query_cache(ecs).bytes(); }},
+};
+
+struct MemoryGroup
+{
+  size_t entities = 0;
+  size_t columnBytes = 0;
+  size_t aiBytes = 0;
+  size_t blackboardBytes = 0;
+
+  size_t total() const { return columnBytes + aiBytes + blackboardBytes + entities * flecs_entity_overhead; }
+
+  void add(const MemoryGroup &other)
+  {
+    entities += other.entities;
+    columnBytes += other.columnBytes;
+    aiBytes += other.aiBytes;
+    blackboardBytes += other.blackboardBytes;
+  }
+};
+
+struct ComponentStats
+{
+  std::string name;
+  size_t entities = 0;
+  size_t bytes = 0;
+};
+
+struct ArchetypeStats
+{
+  std::string name;
+  MemoryGroup group;
+};
+
+struct BlackboardPoolStats
+{
+  const char *name;
+  size_t slots = 0;
+  size_t bytes = 0;
+};
+
+template<typename T>
+static void count_bb_pool(const Blackboard &bb, BlackboardPoolStats &stats)
+{
+  stats.slots += bb.size<T>();
+  stats.bytes += bb.heapBytes<T>();
+}
+
+static double per_entity(size_t bytes, size_t entities)
+{
+  return entities ? double(bytes) / double(entities) : 0.0;
+}
+
+static void print_group(FILE *out, const MemoryGroup &group, const char *name)
+{
+  fprintf(out, "%10zu %12zu %12zu %12zu %12zu %10.1f  %s\n", group.entities, group.columnBytes, group.aiBytes,
+          group.blackboardBytes, group.total(), per_entity(group.total(), group.entities), name);
+}
+
+void print_memory_report(flecs::world &ecs, FILE *out)
+{
+  auto &entitiesQuery = cached_query<const Position>(ecs);
+  // tables having these get a pass over their entities, the rest is accounted per table
+  const flecs::id_t perEntityIds[] = {ecs.id<AiArchetype>().raw_id(), ecs.id<StateMachine>().raw_id(),
+                                      ecs.id<BehaviourTree>().raw_id(), ecs.id<Blackboard>().raw_id()};
+
+  std::unordered_map<flecs::id_t, ComponentStats> byComponent;
+  std::vector<ArchetypeStats> byComponentSet;
+  MemoryGroup byAiArchetype[AI_NUM];
+  AiMemoryStats aiStats;
+  BlackboardPoolStats bbStats[] = {{"float"}, {"int"}, {"entity"}, {"Position"}};
+  size_t numBlackboards = 0;
+
+  // called once per matched table, every table is an archetype
+  entitiesQuery.iter([&](flecs::iter &it, const Position *)
+  {
+    const ecs_type_t *type = ecs_table_get_type(it.c_ptr()->table);
+    const size_t count = size_t(it.count());
+    ArchetypeStats &archetype = byComponentSet.emplace_back();
+    size_t rowBytes = 0;
+    bool perEntity = false;
+    for (int32_t i = 0; i < type->count; ++i)
+    {
+      const flecs::id_t id = type->array[i];
+      // tags and pairs of them have no type info and no column
+      const ecs_type_info_t *info = ecs_get_type_info(ecs.c_ptr(), id);
+      const size_t size = info ? size_t(info->size) : 0;
+      ComponentStats &component = byComponent[id];
+      if (component.name.empty())
+        component.name = flecs::id(ecs.c_ptr(), id).str().c_str();
+      component.entities += count;
+      component.bytes += count * size;
+      archetype.name += (archetype.name.empty() ? "" : ",") + component.name;
+      rowBytes += size;
+      perEntity = perEntity || std::find(std::begin(perEntityIds), std::end(perEntityIds), id) != std::end(perEntityIds);
+    }
+    archetype.group.entities = count;
+    archetype.group.columnBytes = count * rowBytes;
+    if (!perEntity)
+    {
+      byAiArchetype[AI_NONE].add(archetype.group);
+      return;
+    }
+
+    for (size_t row = 0; row < count; ++row)
+    {
+      const flecs::entity e = it.entity(row);
+      MemoryGroup entity;
+      entity.entities = 1;
+      entity.columnBytes = rowBytes;
+
+      const size_t aiBefore = aiStats.total;
+      if (const StateMachine *sm = e.get<StateMachine>())
+        sm->countMemory(aiStats);
+      if (const BehaviourTree *bt = e.get<BehaviourTree>())
+        bt->countMemory(aiStats);
+      entity.aiBytes = aiStats.total - aiBefore;
+
+      if (const Blackboard *bb = e.get<Blackboard>())
+      {
+        numBlackboards++;
+        count_bb_pool<float>(*bb, bbStats[0]);
+        count_bb_pool<int>(*bb, bbStats[1]);
+        count_bb_pool<flecs::entity>(*bb, bbStats[2]);
+        count_bb_pool<Position>(*bb, bbStats[3]);
+        entity.blackboardBytes = bb->heapBytes<float>() + bb->heapBytes<int>() +
+                                 bb->heapBytes<flecs::entity>() + bb->heapBytes<Position>();
+      }
+
+      const AiArchetype *ai = e.get<AiArchetype>();
+      archetype.group.aiBytes += entity.aiBytes;
+      archetype.group.blackboardBytes += entity.blackboardBytes;
+      byAiArchetype[ai && ai->type < AI_NUM ? ai->type : uint8_t(AI_NONE)].add(entity);
+    }
+  });
+
+  MemoryGroup total;
+  for (const MemoryGroup &group : byAiArchetype)
+    total.add(group);
+
+  size_t singletonBytes[std::size(singletons)] = {};
+  size_t singletonTotal = 0;
+  for (size_t i = 0; i < std::size(singletons); ++i)
+    singletonTotal += singletonBytes[i] = singletons[i].bytes(ecs);
+
+  fprintf(out, "Memory report: %zu bytes total, %zu entities, %zu bytes, %.1f bytes/entity "
+          "(flecs overhead estimated at %zu bytes/entity), %zu bytes in world singletons\n",
+          total.total() + singletonTotal, total.entities, total.total(), per_entity(total.total(), total.entities),
+          flecs_entity_overhead, singletonTotal);
+
+  std::vector<const ComponentStats*> components;
+  for (const auto &[id, stats] : byComponent)
+    components.push_back(&stats);
+  std::sort(components.begin(), components.end(), [](const ComponentStats *lhs, const ComponentStats *rhs)
+  {
+    return lhs->bytes != rhs->bytes ? lhs->bytes > rhs->bytes : lhs->name < rhs->name;
+  });
+  fprintf(out, "By component\n");
+  fprintf(out, "  entities        bytes  bytes/entity  component\n");
+  for (const ComponentStats *stats : components)
+    fprintf(out, "%10zu %12zu %13.1f  %s\n", stats->entities, stats->bytes,
+            per_entity(stats->bytes, total.entities), stats->name.c_str());
+
+  const char *header = "  entities      columns     ai graph   blackboard        total  per entity  ";
+  fprintf(out, "By AI archetype\n%sarchetype\n", header);
+  for (uint8_t i = 0; i < AI_NUM; ++i)
+    if (byAiArchetype[i].entities)
+      print_group(out, byAiArchetype[i], ai_archetype_name(i));
+
+  std::sort(byComponentSet.begin(), byComponentSet.end(),
+            [](const ArchetypeStats &lhs, const ArchetypeStats &rhs) { return lhs.group.total() > rhs.group.total(); });
+  fprintf(out, "By archetype (flecs table)\n%scomponents\n", header);
+  for (const ArchetypeStats &archetype : byComponentSet)
+    if (archetype.group.entities)
+      print_group(out, archetype.group, archetype.name.c_str());
+
+  // same literal may live at different addresses in different translation units
+  std::unordered_map<std::string, AiMemoryStats::Entry> aiByName;
+  for (const auto &[type, entry] : aiStats.byType)
+  {
+    AiMemoryStats::Entry &dst = aiByName[type];
+    dst.count += entry.count;
+    dst.bytes += entry.bytes;
+  }
+  std::vector<std::pair<std::string, AiMemoryStats::Entry>> aiTypes(aiByName.begin(), aiByName.end());
+  std::sort(aiTypes.begin(), aiTypes.end(), [](const auto &lhs, const auto &rhs) { return lhs.second.bytes > rhs.second.bytes; });
+  fprintf(out, "By AI graph type\n");
+  fprintf(out, "     count        bytes  avg bytes  type\n");
+  for (const auto &[type, entry] : aiTypes)
+    fprintf(out, "%10zu %12zu %10.1f  %s\n", entry.count, entry.bytes, per_entity(entry.bytes, entry.count), type.c_str());
+  const CoroutineFramePool &pool = coroutine_frame_pool();
+  fprintf(out, "coroutine frames of this thread: %zu bytes live, %zu bytes in free lists\n",
+          pool.getLiveBytes(), pool.getFreeBytes());
+
+  fprintf(out, "World singletons (%zu cached queries, their flecs side not included)\n", query_cache(ecs).size());
+  fprintf(out, "       bytes  singleton\n");
+  for (size_t i = 0; i < std::size(singletons); ++i)
+    if (singletonBytes[i])
+      fprintf(out, "%12zu  %s\n", singletonBytes[i], singletons[i].name);
+
+  fprintf(out, "By blackboard slot type (%zu blackboards)\n", numBlackboards);
+  fprintf(out, "     slots        bytes  bytes/blackboard  type\n");
+  for (const BlackboardPoolStats &stats : bbStats)
+    fprintf(out, "%10zu %12zu %17.1f  %s\n", stats.slots, stats.bytes, per_entity(stats.bytes, numBlackboards), stats.name);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdio>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <flecs.h>
+
+// Memory used by the world, broken down by component, archetype (flecs table), AI archetype,
+// AI graph node type and blackboard slot type, with per entity averages. Components and archetypes
+// come from the types of the tables holding entities with a Position, columns are counted as
+// entities x size, which is what the tables hold without their growth slack. Only entities having
+// AI graphs or blackboards are visited one by one, for their heap data.
+// World singletons (maps, indices, scratch of AI updates, query cache) are listed separately,
+// modules report them through *_memory_bytes functions built on the helpers below.
+void print_memory_report(flecs::world &ecs, FILE *out);
+
+// Heap held by containers. Hash containers are estimated as a bucket array plus a node per element.
+template<typename T>
+size_t heap_bytes(const std::vector<T> &v)
+{
+  return v.capacity() * sizeof(T);
+}
+
+template<typename K, typename V>
+size_t heap_bytes(const std::unordered_map<K, V> &m)
+{
+  return m.bucket_count() * sizeof(void*) + m.size() * (sizeof(std::pair<const K, V>) + 2 * sizeof(void*));
+}
+
+template<typename K>
+size_t heap_bytes(const std::unordered_set<K> &s)
+{
+  return s.bucket_count() * sizeof(void*) + s.size() * (sizeof(K) + 2 * sizeof(void*));
+}
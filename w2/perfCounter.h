@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+
+// Hardware event counter of the calling thread through perf_event_open. Not available on other
+// platforms, in most containers or with a strict perf_event_paranoid, valid() tells.
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class PerfCounter
+{
+  int fd = -1;
+public:
+  PerfCounter(uint32_t type, uint64_t config)
+  {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+  ~PerfCounter()
+  {
+    if (fd >= 0)
+      close(fd);
+  }
+  PerfCounter(const PerfCounter &) = delete;
+  PerfCounter &operator=(const PerfCounter &) = delete;
+
+  bool valid() const { return fd >= 0; }
+
+  void start()
+  {
+    if (fd < 0)
+      return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  uint64_t stop()
+  {
+    uint64_t count = 0;
+    if (fd < 0)
+      return 0;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != ssize_t(sizeof(count)))
+      return 0;
+    return count;
+  }
+};
+
+inline PerfCounter l1d_miss_counter()
+{
+  return PerfCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+inline PerfCounter llc_miss_counter()
+{
+  return PerfCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+}
+#else
+class PerfCounter
+{
+public:
+  bool valid() const { return false; }
+  void start() {}
+  uint64_t stop() { return 0; }
+};
+
+inline PerfCounter l1d_miss_counter() { return PerfCounter(); }
+inline PerfCounter llc_miss_counter() { return PerfCounter(); }
+#endif
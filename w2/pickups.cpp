@@ -0,0 +1,100 @@
+#include "pickups.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "ecsTypes.h"
+#include "queryCache.h"
+#include "memoryReport.h"
+
+struct PickupIndex
+{
+  std::unordered_map<uint64_t, std::vector<flecs::entity_t>> cells;
+};
+
+static uint64_t cell_key(const Position &pos)
+{
+  return uint64_t(uint32_t(pos.x)) | (uint64_t(uint32_t(pos.y)) << 32);
+}
+
+static PickupIndex *get_index(flecs::world ecs)
+{
+  // observers also fire while the world is torn down, don't recreate the singleton then
+  return ecs.has<PickupIndex>() ? ecs.get_mut<PickupIndex>() : nullptr;
+}
+
+template<typename Amount>
+static void register_pickup_observers(flecs::world &ecs)
+{
+  ecs.observer<const Position, const Amount>()
+    .event(flecs::OnSet)
+    .each([](flecs::entity e, const Position &pos, const Amount &)
+    {
+      if (PickupIndex *index = get_index(e.world()))
+      {
+        std::vector<flecs::entity_t> &cell = index->cells[cell_key(pos)];
+        if (std::find(cell.begin(), cell.end(), e.id()) == cell.end())
+          cell.push_back(e.id());
+      }
+    });
+  ecs.observer<const Position, const Amount>()
+    .event(flecs::OnRemove)
+    .each([](flecs::entity e, const Position &pos, const Amount &)
+    {
+      PickupIndex *index = get_index(e.world());
+      if (!index)
+        return;
+      auto itf = index->cells.find(cell_key(pos));
+      if (itf == index->cells.end())
+        return;
+      std::vector<flecs::entity_t> &cell = itf->second;
+      cell.erase(std::remove(cell.begin(), cell.end(), e.id()), cell.end());
+      if (cell.empty())
+        index->cells.erase(itf);
+    });
+}
+
+size_t pickup_index_memory_bytes(flecs::world &ecs)
+{
+  const PickupIndex *index = ecs.get<PickupIndex>();
+  if (!index)
+    return 0;
+  size_t bytes = sizeof(PickupIndex) + heap_bytes(index->cells);
+  for (const auto &[key, cell] : index->cells)
+    bytes += heap_bytes(cell);
+  return bytes;
+}
+
+void register_pickups(flecs::world &ecs)
+{
+  ecs.set(PickupIndex{});
+  register_pickup_observers<HealAmount>(ecs);
+  register_pickup_observers<PowerupAmount>(ecs);
+}
+
+void process_pickups(flecs::world &ecs)
+{
+  auto &collectors = cached_query<const CanPickup, const Position, Hitpoints, MeleeDamage>(ecs);
+  PickupIndex &index = *ecs.get_mut<PickupIndex>();
+  if (index.cells.empty())
+    return;
+  ecs.defer([&]
+  {
+    collectors.each([&](const CanPickup &, const Position &pos, Hitpoints &hp, MeleeDamage &dmg)
+    {
+      auto itf = index.cells.find(cell_key(pos));
+      if (itf == index.cells.end())
+        return;
+      for (flecs::entity_t id : itf->second)
+      {
+        const flecs::entity pickup = ecs.entity(id);
+        if (const HealAmount *heal = pickup.get<HealAmount>())
+          hp.hitpoints += heal->amount;
+        if (const PowerupAmount *power = pickup.get<PowerupAmount>())
+          dmg.damage += power->amount;
+        pickup.destruct();
+      }
+      // unlink right away so nobody else on this cell collects it twice this turn
+      index.cells.erase(itf);
+    });
+  });
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <flecs.h>
+
+// Heals and powerups are kept in a cell hash map maintained by observers, so collecting
+// is a lookup on the collector's cell instead of a scan over all pickups.
+// Anything with CanPickup, Position, Hitpoints and MeleeDamage collects them.
+void register_pickups(flecs::world &ecs);
+size_t pickup_index_memory_bytes(flecs::world &ecs);
+void process_pickups(flecs::world &ecs);
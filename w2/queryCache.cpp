@@ -0,0 +1,16 @@
+#include "queryCache.h"
+
+static void free_query_cache(ecs_world_t *, void *ctx)
+{
+  delete static_cast<QueryCache*>(ctx);
+}
+
+QueryCache &query_cache(flecs::world &ecs)
+{
+  if (void *ctx = ecs.get_context())
+    return *static_cast<QueryCache*>(ctx);
+  QueryCache *cache = new QueryCache();
+  ecs.set_context(cache);
+  ecs_atfini(ecs, free_query_cache, cache);
+  return *cache;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <flecs.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Queries belong to the world that created them. Function-local static queries bind to whichever
+// world runs first, which breaks as soon as several worlds live in one process (batch runs), so
+// systems keep them here instead: one cache per world, stored in the world context and freed with it.
+// Every key type gets a process-wide slot index on first use, lookups are a plain vector access.
+class QueryCache
+{
+  struct HolderBase
+  {
+    virtual ~HolderBase() = default;
+  };
+
+  template<typename Query>
+  struct Holder final : HolderBase
+  {
+    Query query;
+    explicit Holder(Query &&q) : query(std::move(q)) {}
+  };
+
+  std::vector<std::unique_ptr<HolderBase>> holders;
+
+  static size_t next_index()
+  {
+    static std::atomic<size_t> counter{0};
+    return counter.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  template<typename Key>
+  static size_t index_of()
+  {
+    static const size_t idx = next_index();
+    return idx;
+  }
+
+public:
+  // Key has to map to a single query type
+  template<typename Key, typename Build>
+  auto &get(Build &&build)
+  {
+    using Query = decltype(build());
+    const size_t idx = index_of<Key>();
+    if (idx >= holders.size())
+      holders.resize(idx + 1);
+    if (!holders[idx])
+      holders[idx] = std::make_unique<Holder<Query>>(build());
+    return static_cast<Holder<Query>&>(*holders[idx]).query;
+  }
+
+  size_t size() const
+  {
+    size_t count = 0;
+    for (const std::unique_ptr<HolderBase> &holder : holders)
+      count += holder != nullptr;
+    return count;
+  }
+  // holders only, what flecs allocates for the queries themselves isn't visible here
+  size_t bytes() const
+  {
+    return sizeof(QueryCache) + holders.capacity() * sizeof(holders[0]) + size() * sizeof(Holder<flecs::query<>>);
+  }
+};
+
+QueryCache &query_cache(flecs::world &ecs);
+
+template<typename... Comps>
+flecs::query<Comps...> &cached_query(flecs::world &ecs)
+{
+  return query_cache(ecs).get<flecs::query<Comps...>>([&] { return ecs.query<Comps...>(); });
+}
+
+// for queries built with extra terms, Key tells them apart from plain ones with the same components
+template<typename Key, typename Build>
+auto &cached_query(flecs::world &ecs, Build &&build)
+{
+  return query_cache(ecs).get<Key>(std::forward<Build>(build));
+}
@@ -0,0 +1,236 @@
+#include "replay.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <flecs.h>
+#include "roguelike.h"
+
+static constexpr char replay_magic[4] = {'R', 'G', 'R', 'P'};
+static constexpr uint32_t replay_version = 2;
+static constexpr int action_bits = 3;
+static_assert(EA_NUM <= (1 << action_bits), "actions don't fit into replay encoding");
+
+static void put_u32(std::vector<uint8_t> &buf, uint32_t val)
+{
+  for (int i = 0; i < 4; ++i)
+    buf.push_back(uint8_t(val >> (i * 8)));
+}
+
+static void put_u64(std::vector<uint8_t> &buf, uint64_t val)
+{
+  for (int i = 0; i < 8; ++i)
+    buf.push_back(uint8_t(val >> (i * 8)));
+}
+
+static void put_varint(std::vector<uint8_t> &buf, uint64_t val)
+{
+  while (val >= 0x80)
+  {
+    buf.push_back(uint8_t(val | 0x80));
+    val >>= 7;
+  }
+  buf.push_back(uint8_t(val));
+}
+
+static bool get_u8(FILE *file, uint8_t &val)
+{
+  int c = fgetc(file);
+  if (c == EOF)
+    return false;
+  val = uint8_t(c);
+  return true;
+}
+
+static bool get_varint(FILE *file, uint64_t &val)
+{
+  val = 0;
+  for (int shift = 0; shift < 64; shift += 7)
+  {
+    uint8_t byte = 0;
+    if (!get_u8(file, byte))
+      return false;
+    val |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static void sort_actions(std::vector<ResolvedAction> &actions)
+{
+  std::sort(actions.begin(), actions.end(), [](const ResolvedAction &lhs, const ResolvedAction &rhs)
+  {
+    return lhs.eid < rhs.eid;
+  });
+}
+
+ReplayWriter::~ReplayWriter()
+{
+  close();
+}
+
+bool ReplayWriter::open(const char *path, uint64_t seed, const char *scenario)
+{
+  close();
+  file = fopen(path, "wb");
+  if (!file)
+    return false;
+  buffer.clear();
+  buffer.insert(buffer.end(), std::begin(replay_magic), std::end(replay_magic));
+  put_u32(buffer, replay_version);
+  put_u64(buffer, seed);
+  const size_t scenarioLen = scenario ? strlen(scenario) : 0;
+  put_varint(buffer, scenarioLen);
+  buffer.insert(buffer.end(), scenario, scenario + scenarioLen);
+  fwrite(buffer.data(), 1, buffer.size(), file);
+  return true;
+}
+
+void ReplayWriter::close()
+{
+  if (file)
+    fclose(file);
+  file = nullptr;
+}
+
+void ReplayWriter::writeTurn(const TurnLog &log)
+{
+  if (!file)
+    return;
+  sorted = log.actions;
+  sort_actions(sorted);
+
+  buffer.clear();
+  buffer.push_back(uint8_t(log.playerAction));
+  put_varint(buffer, sorted.size());
+  uint64_t prevEid = 0;
+  for (const ResolvedAction &ra : sorted)
+  {
+    put_varint(buffer, ((ra.eid - prevEid) << action_bits) | uint64_t(ra.action));
+    prevEid = ra.eid;
+  }
+  // stdio buffering takes care of batching small turns into bigger disk writes
+  fwrite(buffer.data(), 1, buffer.size(), file);
+}
+
+ReplayReader::~ReplayReader()
+{
+  close();
+}
+
+bool ReplayReader::open(const char *path)
+{
+  close();
+  file = fopen(path, "rb");
+  if (!file)
+    return false;
+  uint8_t header[sizeof(replay_magic) + sizeof(uint32_t) + sizeof(uint64_t)];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, replay_magic, sizeof(replay_magic)) != 0)
+  {
+    close();
+    return false;
+  }
+  uint32_t version = 0;
+  for (int i = 0; i < 4; ++i)
+    version |= uint32_t(header[sizeof(replay_magic) + size_t(i)]) << (i * 8);
+  seed = 0;
+  for (int i = 0; i < 8; ++i)
+    seed |= uint64_t(header[sizeof(replay_magic) + sizeof(uint32_t) + size_t(i)]) << (i * 8);
+  uint64_t scenarioLen = 0;
+  if (version != replay_version || !get_varint(file, scenarioLen))
+  {
+    close();
+    return false;
+  }
+  scenario.resize(scenarioLen);
+  if (fread(scenario.data(), 1, scenario.size(), file) != scenario.size())
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void ReplayReader::close()
+{
+  if (file)
+    fclose(file);
+  file = nullptr;
+}
+
+bool ReplayReader::readTurn(TurnLog &log)
+{
+  if (!file)
+    return false;
+  uint8_t playerAction = 0;
+  uint64_t count = 0;
+  if (!get_u8(file, playerAction) || !get_varint(file, count))
+    return false;
+  log.playerAction = playerAction;
+  log.actions.clear();
+  uint64_t eid = 0;
+  for (uint64_t i = 0; i < count; ++i)
+  {
+    uint64_t packed = 0;
+    if (!get_varint(file, packed))
+      return false;
+    eid += packed >> action_bits;
+    log.actions.push_back(ResolvedAction{eid, int(packed & ((1 << action_bits) - 1))});
+  }
+  return true;
+}
+
+static bool same_actions(const std::vector<ResolvedAction> &lhs, const std::vector<ResolvedAction> &rhs)
+{
+  if (lhs.size() != rhs.size())
+    return false;
+  for (size_t i = 0; i < lhs.size(); ++i)
+    if (lhs[i].eid != rhs[i].eid || lhs[i].action != rhs[i].action)
+      return false;
+  return true;
+}
+
+bool play_replay(const char *path)
+{
+  ReplayReader reader;
+  if (!reader.open(path))
+  {
+    fprintf(stderr, "cannot open replay '%s'\n", path);
+    return false;
+  }
+  flecs::world ecs;
+  ecs.set(WorldSeed{reader.getSeed()});
+  if (!init_roguelike(ecs, true, reader.getScenario()))
+    return false;
+  ecs.set(TurnLog{});
+
+  auto playerQuery = ecs.query<const IsPlayer, Action>();
+  TurnLog recorded;
+  TurnLog simulated;
+  size_t turns = 0;
+  size_t desyncs = 0;
+  const auto start = std::chrono::steady_clock::now();
+  while (reader.readTurn(recorded))
+  {
+    playerQuery.each([&](const IsPlayer &, Action &a)
+    {
+      a.action = recorded.playerAction;
+    });
+    process_turn(ecs);
+
+    simulated = *ecs.get<TurnLog>();
+    sort_actions(simulated.actions);
+    if (!same_actions(simulated.actions, recorded.actions))
+    {
+      if (desyncs == 0)
+        fprintf(stderr, "replay desync at turn %zu\n", turns);
+      desyncs++;
+    }
+    turns++;
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  printf("replayed %zu turns in %.3f s (%.0f turns/s), %zu desynced turns\n",
+         turns, elapsed.count(), elapsed.count() > 0.0 ? double(turns) / elapsed.count() : 0.0, desyncs);
+  return desyncs == 0;
+}
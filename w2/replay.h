@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "ecsTypes.h"
+
+struct ResolvedAction
+{
+  uint64_t eid = 0;
+  int action = EA_NOP;
+};
+
+// World singleton, when present process_turn fills it with player input and
+// all actions that survived resolution (non-NOP) during the last turn.
+struct TurnLog
+{
+  int playerAction = EA_NOP;
+  std::vector<ResolvedAction> actions;
+};
+
+// Replay file layout (little endian):
+//   header: "RGRP", u32 version, u64 seed, varint length + scenario path (empty for the default one)
+//   turn:   u8 player action, varint count, count x varint((eid - prev_eid) << 3 | action)
+// Actions are sorted by entity id so that ids are stored as small deltas.
+class ReplayWriter
+{
+  FILE *file = nullptr;
+  std::vector<uint8_t> buffer;
+  std::vector<ResolvedAction> sorted;
+public:
+  ReplayWriter() = default;
+  ReplayWriter(const ReplayWriter &) = delete;
+  ReplayWriter &operator=(const ReplayWriter &) = delete;
+  ~ReplayWriter();
+
+  bool open(const char *path, uint64_t seed, const char *scenario = nullptr);
+  void close();
+  bool isOpen() const { return file != nullptr; }
+
+  void writeTurn(const TurnLog &log);
+};
+
+class ReplayReader
+{
+  FILE *file = nullptr;
+  uint64_t seed = 0;
+  std::string scenario;
+public:
+  ReplayReader() = default;
+  ReplayReader(const ReplayReader &) = delete;
+  ReplayReader &operator=(const ReplayReader &) = delete;
+  ~ReplayReader();
+
+  bool open(const char *path);
+  void close();
+  uint64_t getSeed() const { return seed; }
+  // nullptr when the default scenario was used
+  const char *getScenario() const { return scenario.empty() ? nullptr : scenario.c_str(); }
+
+  // returns false on end of file or corrupted turn
+  bool readTurn(TurnLog &log);
+};
+
+// Re-simulates a recorded session headless and as fast as possible, checking
+// resolved actions against the log. Returns false on desync or read errors.
+bool play_replay(const char *path);
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <flecs.h>
+#include "ecsTypes.h"
+
+// SplitMix64 finalizer, a good 64 bit mixing function
+inline uint64_t splitmix64(uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// Stateless counter based generator: n-th value is a pure function of (seed, entity, turn, n).
+// There's no shared mutable state, so agents can draw numbers from any thread in any order
+// and a run is fully reproducible from the world seed.
+class CounterRng
+{
+  uint64_t key = 0;
+  uint64_t counter = 0;
+public:
+  CounterRng(uint64_t seed, uint64_t stream, uint64_t turn)
+    : key(splitmix64(splitmix64(splitmix64(seed) ^ stream) ^ turn)) {}
+
+  uint64_t next()
+  {
+    return splitmix64(key ^ splitmix64(counter++));
+  }
+
+  // inclusive range, same contract as raylib's GetRandomValue
+  int range(int from, int to)
+  {
+    const uint64_t span = uint64_t(int64_t(to) - int64_t(from)) + 1;
+    return int(int64_t(from) + int64_t(next() % span));
+  }
+
+  // [0, 1)
+  float uniform()
+  {
+    return float(next() >> 40) * (1.f / float(1 << 24));
+  }
+};
+
+// Generator for the entity's decisions during the current turn
+inline CounterRng entity_rng(const flecs::world &ecs, flecs::entity entity)
+{
+  const WorldSeed *seed = ecs.get<WorldSeed>();
+  const TurnCounter *turn = ecs.get<TurnCounter>();
+  return CounterRng(seed ? seed->seed : 0, entity.id(), turn ? turn->turn : 0);
+}
@@ -2,79 +2,68 @@
 #include "ecsTypes.h"
 #include "raylib.h"
 #include "stateMachine.h"
+#include "behaviourTree.h"
+#include "aiArchetypes.h"
 #include "aiLibrary.h"
 #include "blackboard.h"
+#include "replay.h"
+#include "scenario.h"
+#include "pickups.h"
+#include "utilityAi.h"
+#include "goap.h"
+#include "targetGrid.h"
+#include "mcts.h"
+#include "influenceMap.h"
+#include "dungeonMap.h"
+#include "fov.h"
+#include "aiUtils.h"
+#include "queryCache.h"
+#include "spatialSort.h"
+#include "chunkStreaming.h"
+#include "dormancy.h"
+#include "memoryReport.h"
+#include <algorithm>
+#include <vector>
 
-
-static void create_minotaur_beh(flecs::entity e)
+// Damage pushes entities that just died here, they are removed at the end of the turn
+// without scanning every Hitpoints holder.
+struct KillList
 {
-  e.set(Blackboard{});
-  BehNode *root =
-    selector({
-      sequence({
-        is_low_hp(50.f),
-        find_enemy(e, 4.f, "flee_enemy"),
-        flee(e, "flee_enemy")
-      }),
-      sequence({
-        find_enemy(e, 3.f, "attack_enemy"),
-        move_to_entity(e, "attack_enemy")
-      }),
-      patrol(e, 2.f, "patrol_pos")
-    });
-  e.set(BehaviourTree{root});
-}
+  std::vector<flecs::entity_t> entities;
+};
 
-static flecs::entity create_monster(flecs::world &ecs, int x, int y, Color col, const char *texture_src)
+// Everything the inner resolver loop reads about an attack target, packed together so it streams
+// through one small array instead of three component columns. Hitpoints are cold (only touched
+// on a hit) and stay behind a pointer.
+struct CombatSlot
 {
-  flecs::entity textureSrc = ecs.entity(texture_src);
-  return ecs.entity()
-    .set(Position{x, y})
-    .set(MovePos{x, y})
-    .set(Hitpoints{100.f})
-    .set(Action{EA_NOP})
-    .set(Color{col})
-    .add<TextureSource>(textureSrc)
-    .set(StateMachine{})
-    .set(Team{1})
-    .set(NumActions{1, 0})
-    .set(MeleeDamage{20.f})
-    .set(Blackboard{});
-}
+  MovePos pos;
+  Team team;
+};
 
-static void create_player(flecs::world &ecs, int x, int y, const char *texture_src)
+struct CombatActor
 {
-  flecs::entity textureSrc = ecs.entity(texture_src);
-  ecs.entity("player")
-    .set(Position{x, y})
-    .set(MovePos{x, y})
-    .set(Hitpoints{100.f})
-    //.set(Color{0xee, 0xee, 0xee, 0xff})
-    .set(Action{EA_NOP})
-    .add<IsPlayer>()
-    .set(Team{0})
-    .set(PlayerInput{})
-    .set(NumActions{2, 0})
-    .set(Color{255, 255, 255, 255})
-    .add<TextureSource>(textureSrc)
-    .set(MeleeDamage{50.f});
-}
+  Action *action;
+  Position *pos;
+  MovePos *mpos;
+  float damage;
+  Team team;
+  uint32_t slot; // own target slot, no_slot when the actor can't be attacked
+};
 
-static void create_heal(flecs::world &ecs, int x, int y, float amount)
-{
-  ecs.entity()
-    .set(Position{x, y})
-    .set(HealAmount{amount})
-    .set(Color{0xff, 0x44, 0x44, 0xff});
-}
+static constexpr uint32_t no_slot = ~0u;
 
-static void create_powerup(flecs::world &ecs, int x, int y, float amount)
+// World singleton, arrays are reused between turns
+struct CombatScratch
 {
-  ecs.entity()
-    .set(Position{x, y})
-    .set(PowerupAmount{amount})
-    .set(Color{0xff, 0xff, 0x00, 0xff});
-}
+  std::vector<CombatSlot> targets;
+  std::vector<Hitpoints*> targetHp;
+  std::vector<flecs::entity_t> targetIds;
+  std::vector<uint32_t> slotsById; // target slots sorted by entity id
+  std::vector<CombatActor> actors;
+  std::vector<flecs::entity_t> actorIds;
+};
+
 
 static void register_roguelike_systems(flecs::world &ecs)
 {
@@ -109,59 +98,121 @@ static void register_roguelike_systems(flecs::world &ecs)
     .term<TextureSource>(flecs::Wildcard)
     .each([&](flecs::entity e, const Position &pos, const Color color)
     {
-      const auto textureSrc = e.target<TextureSource>();
-      DrawTextureQuad(*textureSrc.get<Texture2D>(),
+      const Texture2D *texture = e.target<TextureSource>().get<Texture2D>();
+      if (!texture)
+        return;
+      DrawTextureQuad(*texture,
           Vector2{1, 1}, Vector2{0, 0},
           Rectangle{float(pos.x), float(pos.y), 1, 1}, color);
     });
 }
 
 
-void init_roguelike(flecs::world &ecs)
+// flecs keeps ids of C++ component types in process-wide statics that the first registration writes.
+// Everything is registered up front, so worlds created later on other threads (batch runs) only read them
+// instead of racing on a type that is first added mid game. Module singletons are set in init_world.
+static void register_components(flecs::world &ecs)
 {
+  ecs.component<Position>();
+  ecs.component<MovePos>();
+  ecs.component<PatrolPos>();
+  ecs.component<Hitpoints>();
+  ecs.component<Action>();
+  ecs.component<NumActions>();
+  ecs.component<MeleeDamage>();
+  ecs.component<HealAmount>();
+  ecs.component<PowerupAmount>();
+  ecs.component<PlayerInput>();
+  ecs.component<IsPlayer>();
+  ecs.component<CanPickup>();
+  ecs.component<Dormant>();
+  ecs.component<Team>();
+  ecs.component<TextureSource>();
+  ecs.component<WorldSeed>();
+  ecs.component<TurnCounter>();
+  ecs.component<PlanTickCounter>();
+  ecs.component<Color>();
+  ecs.component<Texture2D>();
+  ecs.component<TurnLog>();
+  ecs.component<AiArchetype>();
+  ecs.component<StateMachine>();
+  ecs.component<BehaviourTree>();
+  ecs.component<Blackboard>();
+  ecs.component<SelfSensors>();
+  ecs.component<FieldOfView>();
+  ecs.component<InfluenceStamp>();
+  ecs.component<UtilityAgent>();
+  ecs.component<GoapAgent>();
+  ecs.component<MctsAgent>();
+  ecs.component<MctsSettings>();
+}
+
+static void init_world(flecs::world &ecs, bool headless)
+{
+  register_components(ecs);
+
+  // Headless worlds create the same entities in the same order (just without loading textures),
+  // replays and rng streams are keyed by entity ids so they have to match the windowed game.
+  // Systems are only run by ecs.progress(), which headless worlds never call.
   register_roguelike_systems(ecs);
 
   ecs.entity("swordsman_tex")
-    .set(Texture2D{LoadTexture("assets/swordsman.png")});
+    .set(headless ? Texture2D{} : LoadTexture("assets/swordsman.png"));
   ecs.entity("minotaur_tex")
-    .set(Texture2D{LoadTexture("assets/minotaur.png")});
+    .set(headless ? Texture2D{} : LoadTexture("assets/minotaur.png"));
 
   ecs.observer<Texture2D>()
     .event(flecs::OnRemove)
     .each([](Texture2D texture)
       {
-        UnloadTexture(texture);
+        if (texture.id != 0)
+          UnloadTexture(texture);
       });
 
-  create_minotaur_beh(create_monster(ecs, 5, 5, Color{0xee, 0x00, 0xee, 0xff}, "minotaur_tex"));
-  create_minotaur_beh(create_monster(ecs, 10, -5, Color{0xee, 0x00, 0xee, 0xff}, "minotaur_tex"));
-  create_minotaur_beh(create_monster(ecs, -5, -5, Color{0x11, 0x11, 0x11, 0xff}, "minotaur_tex"));
-  create_minotaur_beh(create_monster(ecs, -5, 5, Color{0, 255, 0, 255}, "minotaur_tex"));
-
-  create_player(ecs, 0, 0, "swordsman_tex");
+  ecs.set(TurnCounter{});
+  ecs.set(PlanTickCounter{});
+  ecs.set(KillList{});
+  ecs.set(CombatScratch{});
+  ecs.set(DungeonMap{});
+  register_pickups(ecs);
+  register_dormancy(ecs);
+  register_influence_maps(ecs);
+  register_target_grid(ecs);
+  register_utility_agents(ecs);
+  register_goap_agents(ecs);
+  register_mcts_agents(ecs);
+}
 
-  create_powerup(ecs, 7, 7, 10.f);
-  create_powerup(ecs, 10, -6, 10.f);
-  create_powerup(ecs, 10, -4, 10.f);
+bool init_roguelike(flecs::world &ecs, bool headless, const char *scenario_path)
+{
+  init_world(ecs, headless);
+  if (scenario_path)
+    return load_scenario(ecs, scenario_path);
+  return load_scenario_from_string(ecs, default_scenario, "default scenario");
+}
 
-  create_heal(ecs, -5, -5, 50.f);
-  create_heal(ecs, -5, 5, 50.f);
+bool init_roguelike_from_string(flecs::world &ecs, bool headless, const char *scenario_text, const char *name)
+{
+  init_world(ecs, headless);
+  return load_scenario_from_string(ecs, scenario_text, name);
 }
 
-static bool is_player_acted(flecs::world &ecs)
+static bool is_player_acted(flecs::world &ecs, TurnLog *log)
 {
-  static auto processPlayer = ecs.query<const IsPlayer, const Action>();
+  auto &processPlayer = cached_query<const IsPlayer, const Action>(ecs);
   bool playerActed = false;
   processPlayer.each([&](const IsPlayer, const Action &a)
   {
     playerActed = a.action != EA_NOP;
+    if (log)
+      log->playerAction = a.action;
   });
   return playerActed;
 }
 
 static bool upd_player_actions_count(flecs::world &ecs)
 {
-  static auto updPlayerActions = ecs.query<const IsPlayer, NumActions>();
+  auto &updPlayerActions = cached_query<const IsPlayer, NumActions>(ecs);
   bool actionsReached = false;
   updPlayerActions.each([&](const IsPlayer, NumActions &na)
   {
@@ -171,97 +222,137 @@ static bool upd_player_actions_count(flecs::world &ecs)
   return actionsReached;
 }
 
-static Position move_pos(Position pos, int action)
+static void remove_dead(flecs::world &ecs, KillList &killList)
 {
-  if (action == EA_MOVE_LEFT)
-    pos.x--;
-  else if (action == EA_MOVE_RIGHT)
-    pos.x++;
-  else if (action == EA_MOVE_UP)
-    pos.y--;
-  else if (action == EA_MOVE_DOWN)
-    pos.y++;
-  return pos;
+  if (killList.entities.empty())
+    return;
+  // one deferred batch of deletes, rows are swapped out of their tables in place without moving
+  // through an intermediate table. Ids go back to flecs for recycling and tables keep their storage
+  ecs.defer([&]
+  {
+    for (flecs::entity_t e : killList.entities)
+      ecs.entity(e).destruct();
+  });
+  killList.entities.clear();
 }
 
-static void process_actions(flecs::world &ecs)
+static uint32_t find_slot(const CombatScratch &scratch, flecs::entity_t id)
 {
-  static auto processActions = ecs.query<Action, Position, MovePos, const MeleeDamage, const Team>();
-  static auto checkAttacks = ecs.query<const MovePos, Hitpoints, const Team>();
-  // Process all actions
+  const auto itf = std::lower_bound(scratch.slotsById.begin(), scratch.slotsById.end(), id,
+                                    [&](uint32_t slot, flecs::entity_t val) { return scratch.targetIds[slot] < val; });
+  return itf != scratch.slotsById.end() && scratch.targetIds[*itf] == id ? *itf : no_slot;
+}
+
+static void process_actions(flecs::world &ecs, TurnLog *log)
+{
+  auto &processActions = cached_query<Action, Position, MovePos, const MeleeDamage, const Team>(ecs);
+  auto &checkAttacks = cached_query<const MovePos, Hitpoints, const Team>(ecs);
+  KillList &killList = *ecs.get_mut<KillList>();
+  CombatScratch &scratch = *ecs.get_mut<CombatScratch>();
+  const DungeonMap &map = *ecs.get<DungeonMap>();
   ecs.defer([&]
   {
+    // gather hot data first, component pointers stay valid as nothing changes tables until the end of the turn
+    scratch.targets.clear();
+    scratch.targetHp.clear();
+    scratch.targetIds.clear();
+    checkAttacks.each([&](flecs::entity enemy, const MovePos &epos, Hitpoints &hp, const Team &enemy_team)
+    {
+      scratch.targets.push_back(CombatSlot{epos, enemy_team});
+      scratch.targetHp.push_back(&hp);
+      scratch.targetIds.push_back(enemy.id());
+    });
+    scratch.slotsById.resize(scratch.targets.size());
+    for (uint32_t i = 0; i < scratch.slotsById.size(); ++i)
+      scratch.slotsById[i] = i;
+    std::sort(scratch.slotsById.begin(), scratch.slotsById.end(),
+              [&](uint32_t lhs, uint32_t rhs) { return scratch.targetIds[lhs] < scratch.targetIds[rhs]; });
+
+    scratch.actors.clear();
+    scratch.actorIds.clear();
     processActions.each([&](flecs::entity entity, Action &a, Position &pos, MovePos &mpos, const MeleeDamage &dmg, const Team &team)
     {
-      Position nextPos = move_pos(pos, a.action);
-      bool blocked = false;
-      checkAttacks.each([&](flecs::entity enemy, const MovePos &epos, Hitpoints &hp, const Team &enemy_team)
+      scratch.actors.push_back(CombatActor{&a, &pos, &mpos, dmg.damage, team, find_slot(scratch, entity.id())});
+      scratch.actorIds.push_back(entity.id());
+    });
+
+    // Process all actions, earlier actors claim cells first
+    for (CombatActor &actor : scratch.actors)
+    {
+      Position nextPos = move_pos(*actor.pos, actor.action->action);
+      bool blocked = map.isWall(nextPos.x, nextPos.y);
+      for (size_t i = 0; i < scratch.targets.size(); ++i)
       {
-        if (entity != enemy && epos == nextPos)
+        const CombatSlot &target = scratch.targets[i];
+        if (i != actor.slot && target.pos == nextPos)
         {
           blocked = true;
-          if (team.team != enemy_team.team)
-            hp.hitpoints -= dmg.damage;
+          if (actor.team.team != target.team.team)
+          {
+            Hitpoints &hp = *scratch.targetHp[i];
+            const bool wasAlive = hp.hitpoints > 0.f;
+            hp.hitpoints -= actor.damage;
+            if (wasAlive && hp.hitpoints <= 0.f)
+              killList.entities.push_back(scratch.targetIds[i]);
+          }
         }
-      });
+      }
       if (blocked)
-        a.action = EA_NOP;
+        actor.action->action = EA_NOP;
       else
-        mpos = nextPos;
-    });
+      {
+        *actor.mpos = nextPos;
+        if (actor.slot != no_slot)
+          scratch.targets[actor.slot].pos = nextPos;
+      }
+    }
     // now move
-    processActions.each([&](Action &a, Position &pos, MovePos &mpos, const MeleeDamage &, const Team&)
+    for (size_t i = 0; i < scratch.actors.size(); ++i)
     {
-      pos = mpos;
-      a.action = EA_NOP;
-    });
+      const CombatActor &actor = scratch.actors[i];
+      if (log && actor.action->action != EA_NOP)
+        log->actions.push_back(ResolvedAction{scratch.actorIds[i], actor.action->action});
+      *actor.pos = *actor.mpos;
+      actor.action->action = EA_NOP;
+    }
   });
 
-  static auto deleteAllDead = ecs.query<const Hitpoints>();
-  ecs.defer([&]
-  {
-    deleteAllDead.each([&](flecs::entity entity, const Hitpoints &hp)
-    {
-      if (hp.hitpoints <= 0.f)
-        entity.destruct();
-    });
-  });
+  remove_dead(ecs, killList);
 
-  static auto playerPickup = ecs.query<const IsPlayer, const Position, Hitpoints, MeleeDamage>();
-  static auto healPickup = ecs.query<const Position, const HealAmount>();
-  static auto powerupPickup = ecs.query<const Position, const PowerupAmount>();
-  ecs.defer([&]
-  {
-    playerPickup.each([&](const IsPlayer&, const Position &pos, Hitpoints &hp, MeleeDamage &dmg)
-    {
-      healPickup.each([&](flecs::entity entity, const Position &ppos, const HealAmount &amt)
-      {
-        if (pos == ppos)
-        {
-          hp.hitpoints += amt.amount;
-          entity.destruct();
-        }
-      });
-      powerupPickup.each([&](flecs::entity entity, const Position &ppos, const PowerupAmount &amt)
-      {
-        if (pos == ppos)
-        {
-          dmg.damage += amt.amount;
-          entity.destruct();
-        }
-      });
-    });
-  });
+  process_pickups(ecs);
 }
 
-void process_turn(flecs::world &ecs)
+bool process_turn(flecs::world &ecs)
 {
-  static auto stateMachineAct = ecs.query<StateMachine>();
-  static auto behTreeUpdate = ecs.query<BehaviourTree, Blackboard>();
-  if (is_player_acted(ecs))
+  // dormant agents don't plan until an enemy comes near
+  auto &stateMachineAct = cached_query<struct AwakeStateMachinesQuery>(ecs, [&]
+  {
+    return ecs.query_builder<StateMachine>()
+      .term<Dormant>().not_()
+      .build();
+  });
+  auto &behTreeUpdate = cached_query<struct AwakeBehTreesQuery>(ecs, [&]
+  {
+    return ecs.query_builder<BehaviourTree, Blackboard>()
+      .term<Dormant>().not_()
+      .build();
+  });
+  // fetched outside of deferred blocks so we write straight into the singleton
+  TurnLog *log = ecs.has<TurnLog>() ? ecs.get_mut<TurnLog>() : nullptr;
+  if (log)
+  {
+    log->playerAction = EA_NOP;
+    log->actions.clear();
+  }
+  if (is_player_acted(ecs, log))
   {
     if (upd_player_actions_count(ecs))
     {
+      ecs.get_mut<PlanTickCounter>()->tick++;
+      update_dormancy(ecs);
+      update_influence_maps(ecs);
+      update_fields_of_view(ecs);
+      update_self_sensors(ecs);
       // Plan action for NPCs
       ecs.defer([&]
       {
@@ -273,15 +364,47 @@ void process_turn(flecs::world &ecs)
         {
           bt.update(ecs, e, bb);
         });
+        // shared by utility and GOAP agents
+        update_target_grid(ecs);
+        update_utility_agents(ecs);
+        update_goap_agents(ecs);
+        // last, so it sees what everyone else is going to do this turn
+        update_mcts_agents(ecs);
       });
     }
-    process_actions(ecs);
+    process_actions(ecs, log);
+    uint64_t &turn = ecs.get_mut<TurnCounter>()->turn;
+    if (++turn % spatial_sort_period == 0)
+      sort_by_morton(ecs);
+    update_chunk_streaming(ecs);
+    return true;
   }
+  return false;
+}
+
+void draw_dungeon(flecs::world &ecs)
+{
+  ecs.get<DungeonMap>()->forEachWall([](int x, int y)
+  {
+    DrawRectangleRec(Rectangle{float(x), float(y), 1, 1}, GetColor(0x5a4a3aff));
+  });
+}
+
+size_t turn_scratch_memory_bytes(flecs::world &ecs)
+{
+  size_t bytes = 0;
+  if (const KillList *killList = ecs.get<KillList>())
+    bytes += sizeof(KillList) + heap_bytes(killList->entities);
+  if (const CombatScratch *scratch = ecs.get<CombatScratch>())
+    bytes += sizeof(CombatScratch) + heap_bytes(scratch->targets) + heap_bytes(scratch->targetHp) +
+             heap_bytes(scratch->targetIds) + heap_bytes(scratch->slotsById) + heap_bytes(scratch->actors) +
+             heap_bytes(scratch->actorIds);
+  return bytes;
 }
 
 void print_stats(flecs::world &ecs)
 {
-  static auto playerStatsQuery = ecs.query<const IsPlayer, const Hitpoints, const MeleeDamage>();
+  auto &playerStatsQuery = cached_query<const IsPlayer, const Hitpoints, const MeleeDamage>(ecs);
   playerStatsQuery.each([&](const IsPlayer &, const Hitpoints &hp, const MeleeDamage &dmg)
   {
     DrawText(TextFormat("hp: %d", int(hp.hitpoints)), 20, 20, 20, WHITE);
@@ -2,6 +2,15 @@
 
 #include <flecs.h>
 
-void init_roguelike(flecs::world &ecs);
-void process_turn(flecs::world &ecs);
+// headless doesn't load textures, used for replays and simulations. Both modes create the same
+// entities in the same order, so entity ids (and everything keyed by them) match.
+// Spawns entities from scenario_path or the built-in default scenario, returns false if it fails to load.
+bool init_roguelike(flecs::world &ecs, bool headless = false, const char *scenario_path = nullptr);
+// same with scenario text generated in place, name is used in parse errors
+bool init_roguelike_from_string(flecs::world &ecs, bool headless, const char *scenario_text, const char *name);
+// returns true when the player acted and the turn was simulated
+bool process_turn(flecs::world &ecs);
+void draw_dungeon(flecs::world &ecs);
 void print_stats(flecs::world &ecs);
+// kill list and combat resolver scratch
+size_t turn_scratch_memory_bytes(flecs::world &ecs);
@@ -0,0 +1,339 @@
+#include "scenario.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "raylib.h"
+#include "ecsTypes.h"
+#include "stateMachine.h"
+#include "behaviourTree.h"
+#include "blackboard.h"
+#include "aiArchetypes.h"
+#include "bulkSpawn.h"
+#include "rng.h"
+#include "influenceMap.h"
+#include "dungeonMap.h"
+#include "fov.h"
+
+const char *default_scenario = R"(
+type minotaur hp=100 damage=20 team=1 ai=minotaur texture=minotaur_tex color=ee00eeff
+type swordsman player=1 pickup=1 hp=100 damage=50 team=0 actions=2 texture=swordsman_tex color=ffffffff
+type heal heal=50 color=ff4444ff
+type powerup power=10 color=ffff00ff
+
+spawn minotaur 1 5 5
+spawn minotaur 1 10 -5
+spawn minotaur 1 -5 -5 color=111111ff
+spawn minotaur 1 -5 5 color=00ff00ff
+
+spawn swordsman 1 0 0
+
+spawn powerup 1 7 7
+spawn powerup 1 10 -6
+spawn powerup 1 10 -4
+
+spawn heal 1 -5 -5
+spawn heal 1 -5 5
+)";
+
+struct EntityType
+{
+  float hitpoints = 0.f;
+  float damage = 0.f;
+  int team = 0;
+  int numActions = 1;
+  uint8_t ai = AI_NONE;
+  std::string texture;
+  Color color = Color{0xff, 0xff, 0xff, 0xff};
+  float heal = 0.f;
+  float power = 0.f;
+  bool player = false;
+  bool pickup = false;
+
+  bool isActor() const { return hitpoints > 0.f; }
+};
+
+struct WallCommand
+{
+  int x0 = 0, y0 = 0;
+  int x1 = 0, y1 = 0;
+};
+
+struct SpawnCommand
+{
+  EntityType type;
+  int count = 1;
+  int x0 = 0, y0 = 0;
+  int x1 = 0, y1 = 0;
+};
+
+struct ScenarioCommands
+{
+  std::vector<WallCommand> walls;
+  std::vector<SpawnCommand> spawns;
+};
+
+static bool parse_color(const std::string &str, Color &col)
+{
+  char *end = nullptr;
+  const unsigned long rgba = strtoul(str.c_str(), &end, 16);
+  if (str.size() != 8 || *end != '\0')
+    return false;
+  col = Color{uint8_t(rgba >> 24), uint8_t(rgba >> 16), uint8_t(rgba >> 8), uint8_t(rgba)};
+  return true;
+}
+
+static bool apply_type_key(EntityType &type, const std::string &kv)
+{
+  const size_t eq = kv.find('=');
+  if (eq == std::string::npos)
+    return false;
+  const std::string key = kv.substr(0, eq);
+  const std::string val = kv.substr(eq + 1);
+  if (key == "hp")
+    type.hitpoints = strtof(val.c_str(), nullptr);
+  else if (key == "damage")
+    type.damage = strtof(val.c_str(), nullptr);
+  else if (key == "team")
+    type.team = atoi(val.c_str());
+  else if (key == "actions")
+    type.numActions = atoi(val.c_str());
+  else if (key == "heal")
+    type.heal = strtof(val.c_str(), nullptr);
+  else if (key == "power")
+    type.power = strtof(val.c_str(), nullptr);
+  else if (key == "player")
+    type.player = atoi(val.c_str()) != 0;
+  else if (key == "pickup")
+    type.pickup = atoi(val.c_str()) != 0;
+  else if (key == "texture")
+    type.texture = val;
+  else if (key == "color")
+    return parse_color(val, type.color);
+  else if (key == "ai")
+    return (type.ai = find_ai_archetype(val.c_str())) != AI_NUM;
+  else
+    return false;
+  return true;
+}
+
+// texture entities are created by init_world, a name of anything else would be drawn from a null texture
+static bool is_texture(flecs::world &ecs, const std::string &texture)
+{
+  if (texture.empty())
+    return true;
+  const flecs::entity e = ecs.lookup(texture.c_str());
+  return e.is_alive() && e.has<Texture2D>();
+}
+
+static bool parse_scenario(flecs::world &ecs, const char *text, const char *name, ScenarioCommands &commands)
+{
+  std::unordered_map<std::string, EntityType> types;
+  std::istringstream input(text);
+  std::string line;
+  for (int lineNo = 1; std::getline(input, line); ++lineNo)
+  {
+    line = line.substr(0, line.find('#'));
+    std::istringstream tokens(line);
+    std::string directive;
+    if (!(tokens >> directive))
+      continue;
+    auto error = [&](const char *msg)
+    {
+      fprintf(stderr, "%s:%d: %s\n", name, lineNo, msg);
+      return false;
+    };
+
+    if (directive == "type")
+    {
+      std::string typeName;
+      if (!(tokens >> typeName))
+        return error("type name expected");
+      EntityType type;
+      for (std::string kv; tokens >> kv;)
+        if (!apply_type_key(type, kv))
+          return error("invalid type property");
+      if (!is_texture(ecs, type.texture))
+        return error("unknown texture");
+      types[typeName] = type;
+    }
+    else if (directive == "spawn")
+    {
+      std::string typeName;
+      SpawnCommand cmd;
+      if (!(tokens >> typeName >> cmd.count >> cmd.x0 >> cmd.y0))
+        return error("expected: spawn <type> <count> <x0> <y0> [<x1> <y1>]");
+      const auto itf = types.find(typeName);
+      if (itf == types.end())
+        return error("unknown type");
+      cmd.type = itf->second;
+      cmd.x1 = cmd.x0;
+      cmd.y1 = cmd.y0;
+      std::string token;
+      if (tokens >> token)
+      {
+        if (token.find('=') == std::string::npos)
+        {
+          cmd.x1 = atoi(token.c_str());
+          if (!(tokens >> cmd.y1))
+            return error("region end expected");
+          token.clear();
+          tokens >> token;
+        }
+        for (; !token.empty(); token.clear(), tokens >> token)
+          if (!apply_type_key(cmd.type, token))
+            return error("invalid type property");
+        if (!is_texture(ecs, cmd.type.texture))
+          return error("unknown texture");
+      }
+      if (cmd.count < 0 || cmd.x1 < cmd.x0 || cmd.y1 < cmd.y0)
+        return error("invalid spawn region");
+      commands.spawns.push_back(cmd);
+    }
+    else if (directive == "wall")
+    {
+      WallCommand cmd;
+      if (!(tokens >> cmd.x0 >> cmd.y0))
+        return error("expected: wall <x0> <y0> [<x1> <y1>]");
+      cmd.x1 = cmd.x0;
+      cmd.y1 = cmd.y0;
+      if ((tokens >> cmd.x1) && !(tokens >> cmd.y1))
+        return error("region end expected");
+      if (cmd.x1 < cmd.x0 || cmd.y1 < cmd.y0)
+        return error("invalid wall region");
+      commands.walls.push_back(cmd);
+    }
+    else
+      return error("unknown directive");
+  }
+  return true;
+}
+
+// columns of a single spawn batch, reused between batches
+struct SpawnColumns
+{
+  std::vector<Position> pos;
+  std::vector<MovePos> mpos;
+  std::vector<PatrolPos> ppos;
+  std::vector<Hitpoints> hp;
+  std::vector<Action> action;
+  std::vector<Team> team;
+  std::vector<NumActions> numActions;
+  std::vector<MeleeDamage> damage;
+  std::vector<Color> color;
+  std::vector<AiArchetype> ai;
+  std::vector<HealAmount> heal;
+  std::vector<PowerupAmount> power;
+};
+
+template<typename T>
+static const T *fill_column(std::vector<T> &column, size_t count, const T &val)
+{
+  column.assign(count, val);
+  return column.data();
+}
+
+static constexpr int spawn_batch_size = 1 << 16;
+
+static void spawn_command(flecs::world &ecs, const SpawnCommand &cmd, uint64_t stream, SpawnColumns &columns)
+{
+  const EntityType &type = cmd.type;
+  const WorldSeed *seed = ecs.get<WorldSeed>();
+  CounterRng rng(seed ? seed->seed : 0, stream, 0);
+  for (int spawned = 0; spawned < cmd.count; spawned += spawn_batch_size)
+  {
+    const size_t count = size_t(std::min(spawn_batch_size, cmd.count - spawned));
+    columns.pos.resize(count);
+    for (Position &pos : columns.pos)
+    {
+      // a few rerolls to avoid walls, a region full of walls spawns inside them anyway
+      for (int attempt = 0; attempt < 16; ++attempt)
+      {
+        pos = Position{rng.range(cmd.x0, cmd.x1), rng.range(cmd.y0, cmd.y1)};
+        if (!is_wall(ecs, pos.x, pos.y))
+          break;
+      }
+    }
+
+    BulkSpawner spawner(ecs);
+    spawner.add<Position>(columns.pos.data());
+    spawner.add<Color>(fill_column(columns.color, count, type.color));
+    if (!type.texture.empty())
+      spawner.addPair<TextureSource>(ecs.lookup(type.texture.c_str()));
+    if (type.heal > 0.f)
+      spawner.add<HealAmount>(fill_column(columns.heal, count, HealAmount{type.heal}));
+    if (type.power > 0.f)
+      spawner.add<PowerupAmount>(fill_column(columns.power, count, PowerupAmount{type.power}));
+    if (type.isActor())
+    {
+      columns.mpos.resize(count);
+      for (size_t i = 0; i < count; ++i)
+        columns.mpos[i] = columns.pos[i];
+      spawner.add<MovePos>(columns.mpos.data());
+      spawner.add<Hitpoints>(fill_column(columns.hp, count, Hitpoints{type.hitpoints}));
+      spawner.add<Action>(fill_column(columns.action, count, Action{EA_NOP}));
+      spawner.add<Team>(fill_column(columns.team, count, Team{type.team}));
+      spawner.add<NumActions>(fill_column(columns.numActions, count, NumActions{type.numActions, 0}));
+      spawner.add<MeleeDamage>(fill_column(columns.damage, count, MeleeDamage{type.damage}));
+      spawner.add<InfluenceStamp>(); // stamped on the next influence update
+    }
+    if (type.player)
+      spawner.add<IsPlayer>().add<PlayerInput>();
+    if (type.pickup && type.isActor())
+      spawner.add<CanPickup>();
+    if (type.ai != AI_NONE)
+    {
+      columns.ppos.resize(count);
+      for (size_t i = 0; i < count; ++i)
+        columns.ppos[i] = PatrolPos{columns.pos[i].x, columns.pos[i].y};
+      spawner.add<AiArchetype>(fill_column(columns.ai, count, AiArchetype{type.ai}));
+      spawner.add<PatrolPos>(columns.ppos.data());
+      spawner.add<FieldOfView>();
+      add_ai_archetype_components(spawner, type.ai);
+    }
+
+    const flecs::entity_t *created = spawner.spawn(int32_t(count));
+    if (type.ai != AI_NONE)
+    {
+      // behaviours are object graphs bound to their entity, they can't be bulk copied
+      const std::vector<flecs::entity_t> entities(created, created + count);
+      for (flecs::entity_t e : entities)
+        apply_ai_archetype(ecs.entity(e), type.ai);
+    }
+  }
+}
+
+bool load_scenario_from_string(flecs::world &ecs, const char *text, const char *name)
+{
+  ScenarioCommands commands;
+  if (!parse_scenario(ecs, text, name, commands))
+    return false;
+  DungeonMap &map = *ecs.get_mut<DungeonMap>();
+  for (const WallCommand &wall : commands.walls)
+    for (int y = wall.y0; y <= wall.y1; ++y)
+      for (int x = wall.x0; x <= wall.x1; ++x)
+        map.setWall(x, y, true);
+  SpawnColumns columns;
+  for (size_t i = 0; i < commands.spawns.size(); ++i)
+    spawn_command(ecs, commands.spawns[i], i, columns);
+  return true;
+}
+
+bool load_scenario(flecs::world &ecs, const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "cannot open scenario '%s'\n", path);
+    return false;
+  }
+  std::string text;
+  char buf[4096];
+  for (size_t len; (len = fread(buf, 1, sizeof(buf), file)) > 0;)
+    text.append(buf, len);
+  fclose(file);
+  return load_scenario_from_string(ecs, text.c_str(), path);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <flecs.h>
+
+// Scenario files describe entity types and where to spawn them, one directive per line:
+//   type <name> key=value...          define an entity type
+//   spawn <type> <count> <x0> <y0> [<x1> <y1>] [key=value...]
+//                                     spawn count entities at random cells of the inclusive region,
+//                                     key=value pairs override the type for this spawn only
+//   wall <x0> <y0> [<x1> <y1>]        fill the inclusive region with walls, applied before any spawns
+// Type keys: hp, damage, team, actions, ai (archetype name), texture, color (rrggbbaa hex),
+//            heal, power, player (0/1), pickup (0/1, actor collects heals and powerups).
+// Types with hp are actors, types without it are pickups. '#' starts a comment.
+// Each spawn line is created with flecs bulk operations, so entities land in their final table directly.
+
+extern const char *default_scenario;
+
+bool load_scenario(flecs::world &ecs, const char *path);
+bool load_scenario_from_string(flecs::world &ecs, const char *text, const char *name);
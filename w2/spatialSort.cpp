@@ -0,0 +1,156 @@
+#include "spatialSort.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <float.h>
+#include <string>
+#include <vector>
+#include "ecsTypes.h"
+#include "roguelike.h"
+#include "math.h"
+#include "perfCounter.h"
+#include "queryCache.h"
+
+static int compare_morton(flecs::entity_t e1, const Position *p1, flecs::entity_t e2, const Position *p2)
+{
+  const uint32_t c1 = morton_code(p1->x, p1->y);
+  const uint32_t c2 = morton_code(p2->x, p2->y);
+  if (c1 != c2)
+    return c1 < c2 ? -1 : 1;
+  return (e1 > e2) - (e1 < e2);
+}
+
+void sort_by_morton(flecs::world &ecs)
+{
+  auto &sortQuery = cached_query<struct MortonSortQuery>(ecs, [&]
+  {
+    return ecs.query_builder<const Position>()
+      .order_by<Position>(compare_morton)
+      .build();
+  });
+  // iterating is what makes flecs sort the changed tables
+  sortQuery.each([](const Position &) {});
+}
+
+// Entity ids bucketed by cell over a dense square, built in row order like a spatial index would be
+struct CellGrid
+{
+  int origin = 0;
+  int size = 0;
+  std::vector<uint32_t> cellStart;
+  std::vector<flecs::entity_t> ids;
+
+  void build(flecs::world &ecs, int radius)
+  {
+    auto &positionsQuery = cached_query<const Position, const Team>(ecs);
+    origin = -radius;
+    size = radius * 2 + 1;
+    cellStart.assign(size_t(size * size) + 1, 0);
+    positionsQuery.each([&](const Position &pos, const Team &) { cellStart[cellIdx(pos.x, pos.y) + 1]++; });
+    for (size_t i = 1; i < cellStart.size(); ++i)
+      cellStart[i] += cellStart[i - 1];
+    ids.resize(cellStart.back());
+    std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+    positionsQuery.each([&](flecs::entity e, const Position &pos, const Team &) { ids[fill[cellIdx(pos.x, pos.y)]++] = e.id(); });
+  }
+
+  size_t cellIdx(int x, int y) const
+  {
+    return size_t(std::clamp(y - origin, 0, size - 1) * size + std::clamp(x - origin, 0, size - 1));
+  }
+};
+
+struct ScanResult
+{
+  double seconds = 0.0;
+  uint64_t l1dMisses = 0;
+  uint64_t llcMisses = 0;
+  bool hasCounters = false;
+  int found = 0;
+};
+
+static constexpr int scan_radius = 4;
+
+// on_closest_enemy_pos over the neighbourhood instead of all entities: agents go in row order,
+// neighbours are read through their ids, which is where row order starts to matter
+static ScanResult scan_closest_enemies(flecs::world &ecs, const CellGrid &grid, int passes)
+{
+  auto &agentsQuery = cached_query<const Position, const Team>(ecs);
+  PerfCounter l1d = l1d_miss_counter();
+  PerfCounter llc = llc_miss_counter();
+  ScanResult res;
+  res.hasCounters = l1d.valid() && llc.valid();
+  l1d.start();
+  llc.start();
+  const auto start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < passes; ++pass)
+    agentsQuery.each([&](const Position &pos, const Team &team)
+    {
+      float closestDist = FLT_MAX;
+      for (int y = pos.y - scan_radius; y <= pos.y + scan_radius; ++y)
+        for (int x = pos.x - scan_radius; x <= pos.x + scan_radius; ++x)
+        {
+          const size_t cell = grid.cellIdx(x, y);
+          for (uint32_t i = grid.cellStart[cell]; i < grid.cellStart[cell + 1]; ++i)
+          {
+            const flecs::entity enemy = ecs.entity(grid.ids[i]);
+            const Team *enemyTeam = enemy.get<Team>();
+            if (enemyTeam->team == team.team)
+              continue;
+            closestDist = std::min(closestDist, dist(*enemy.get<Position>(), pos));
+          }
+        }
+      res.found += closestDist < FLT_MAX;
+    });
+  res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  res.l1dMisses = l1d.stop();
+  res.llcMisses = llc.stop();
+  return res;
+}
+
+static void print_scan(const char *name, const ScanResult &res, double lookups)
+{
+  printf("%-9s %8.1f ns/agent", name, res.seconds / lookups * 1e9);
+  if (res.hasCounters)
+    printf(" %8.2f L1D misses/agent %8.3f LLC misses/agent",
+           double(res.l1dMisses) / lookups, double(res.llcMisses) / lookups);
+  printf("\n");
+}
+
+int run_spatial_sort_benchmark(int num_agents)
+{
+  flecs::world ecs;
+  ecs.set(WorldSeed{1});
+  const int radius = int(sqrtf(float(num_agents)));
+  char region[64];
+  snprintf(region, sizeof(region), " %d %d %d %d\n", -radius, -radius, radius, radius);
+  // bulk spawned at random cells, so rows start out in no spatial order at all
+  const std::string text =
+    "type red hp=100 damage=10 team=0\n"
+    "type blue hp=100 damage=10 team=1\n"
+    "spawn red " + std::to_string(num_agents / 2) + region +
+    "spawn blue " + std::to_string(num_agents - num_agents / 2) + region;
+  if (!init_roguelike_from_string(ecs, true, text.c_str(), "spatial sort benchmark"))
+    return 1;
+
+  const int passes = 5;
+  CellGrid grid;
+  grid.build(ecs, radius);
+  const ScanResult unsorted = scan_closest_enemies(ecs, grid, passes);
+
+  const auto sortStart = std::chrono::steady_clock::now();
+  sort_by_morton(ecs);
+  const double sortSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sortStart).count();
+  grid.build(ecs, radius);
+  const ScanResult sorted = scan_closest_enemies(ecs, grid, passes);
+
+  const double lookups = double(num_agents) * passes;
+  printf("%d agents, %d passes, sort took %.2f ms\n", num_agents, passes, sortSeconds * 1e3);
+  print_scan("unsorted", unsorted, lookups);
+  print_scan("morton", sorted, lookups);
+  if (!sorted.hasCounters)
+    printf("perf events unavailable, cache misses not measured\n");
+  printf("speedup %.2fx\n", unsorted.seconds / sorted.seconds);
+  return unsorted.found == sorted.found ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <flecs.h>
+
+// Interleaves the low 16 bits of x and y (z-order curve), cells close on the map get close codes
+inline uint32_t morton_code(int x, int y)
+{
+  auto spread = [](uint32_t v)
+  {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  };
+  // offset so that negative coordinates sort before positive ones
+  return spread(uint32_t(x + 0x8000)) | (spread(uint32_t(y + 0x8000)) << 1);
+}
+
+// Reorders rows of every table holding a Position by the Morton code of it, so entities close on
+// the map are close in memory too. Goes through a flecs order_by query, which sorts table storage
+// in place when iterated and skips tables that didn't change since the previous pass.
+// Ties are broken by entity id, the resulting order (and so action resolution) is deterministic.
+void sort_by_morton(flecs::world &ecs);
+
+// process_turn sorts every this many turns, entities drift slowly so it stays mostly in order between passes
+static constexpr uint64_t spatial_sort_period = 16;
+
+// Times nearest enemy lookups through a grid of entity ids before and after sorting,
+// with L1D/LLC miss counts when perf events are available
+int run_spatial_sort_benchmark(int num_agents);
@@ -1,4 +1,5 @@
 #include "stateMachine.h"
+#include "aiProfiler.h"
 
 StateMachine::~StateMachine()
 {
@@ -13,16 +14,24 @@ StateMachine::~StateMachine()
 
 void StateMachine::act(float dt, flecs::world &ecs, flecs::entity entity)
 {
+  AiProfileScope profile(this, 0);
   if (curStateIdx < states.size())
   {
-    for (const std::pair<StateTransition*, int> &transition : transitions[curStateIdx])
-      if (transition.first->isAvailable(ecs, entity))
+    const std::vector<std::pair<StateTransition*, int>> &stateTransitions = transitions[curStateIdx];
+    for (size_t i = 0; i < stateTransitions.size(); ++i)
+    {
+      AiProfileScope transProfile(stateTransitions[i].first, curStateIdx, i);
+      const bool available = stateTransitions[i].first->isAvailable(ecs, entity);
+      transProfile.result(available ? APR_TAKEN : APR_NOT_TAKEN);
+      if (available)
       {
         states[curStateIdx]->exit();
-        curStateIdx = size_t(transition.second);
+        curStateIdx = size_t(stateTransitions[i].second);
         states[curStateIdx]->enter();
         break;
       }
+    }
+    AiProfileScope stateProfile(states[curStateIdx], curStateIdx);
     states[curStateIdx]->act(dt, ecs, entity);
   }
   else
@@ -37,6 +46,20 @@ int StateMachine::addState(State *st)
   return int(idx);
 }
 
+void StateMachine::countMemory(AiMemoryStats &stats) const
+{
+  size_t bytes = sizeof(*this) + states.capacity() * sizeof(State*) +
+                 transitions.capacity() * sizeof(transitions[0]);
+  for (const auto &transList : transitions)
+    bytes += transList.capacity() * sizeof(transList[0]);
+  stats.add(name(), bytes);
+  for (const State *state : states)
+    state->countMemory(stats);
+  for (const auto &transList : transitions)
+    for (const auto &transition : transList)
+      transition.first->countMemory(stats);
+}
+
 void StateMachine::addTransition(StateTransition *trans, int from, int to)
 {
   transitions[size_t(from)].push_back(std::make_pair(trans, to));
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <flecs.h>
+#include "aiMemory.h"
 
 class State
 {
@@ -9,6 +10,8 @@ public:
   virtual void enter() const = 0;
   virtual void exit() const = 0;
   virtual void act(float dt, flecs::world &ecs, flecs::entity entity) const = 0;
+  virtual const char *name() const { return "State"; }
+  virtual void countMemory(AiMemoryStats &stats) const = 0;
 };
 
 class StateTransition
@@ -16,6 +19,9 @@ class StateTransition
 public:
   virtual ~StateTransition() {}
   virtual bool isAvailable(flecs::world &ecs, flecs::entity entity) const = 0;
+  virtual const char *name() const { return "StateTransition"; }
+  // transitions owning others pass stats down to them
+  virtual void countMemory(AiMemoryStats &stats) const = 0;
 };
 
 class StateMachine
@@ -38,5 +44,12 @@ public:
 
   int addState(State *st);
   void addTransition(StateTransition *trans, int from, int to);
+
+  size_t getCurState() const { return curStateIdx; }
+  void setCurState(size_t idx) { curStateIdx = idx; }
+
+  void countMemory(AiMemoryStats &stats) const;
+
+  const char *name() const { return "StateMachine"; }
 };
 
@@ -0,0 +1,78 @@
+#pragma once
+#include "staticBehaviourTree.h"
+#include "behActions.h"
+
+namespace static_bt
+{
+
+// slots
+struct FleeEnemySlot { using type = flecs::entity; };
+struct AttackEnemySlot { using type = flecs::entity; };
+struct PatrolPosSlot { using type = Position; };
+
+// leaves, distances and hitpoints are integers to keep them usable as template arguments
+template<typename Slot>
+struct MoveToEntity
+{
+  template<typename Bb>
+  static BehResult update(flecs::world &, flecs::entity entity, Bb &bb)
+  {
+    return move_to_entity_action(entity, bb.template get<Slot>());
+  }
+};
+
+template<int Threshold>
+struct IsLowHp
+{
+  template<typename Bb>
+  static BehResult update(flecs::world &, flecs::entity entity, Bb &)
+  {
+    return is_low_hp_check(entity, float(Threshold));
+  }
+};
+
+template<int Dist, typename Slot>
+struct FindEnemy
+{
+  template<typename Bb>
+  static BehResult update(flecs::world &ecs, flecs::entity entity, Bb &bb)
+  {
+    return find_enemy_action(ecs, entity, float(Dist), bb.template get<Slot>());
+  }
+};
+
+template<typename Slot>
+struct Flee
+{
+  template<typename Bb>
+  static BehResult update(flecs::world &ecs, flecs::entity entity, Bb &bb)
+  {
+    return flee_action(ecs, entity, bb.template get<Slot>());
+  }
+};
+
+template<int PatrolDist, typename Slot>
+struct Patrol
+{
+  template<typename Bb>
+  static void init(flecs::entity entity, Bb &bb)
+  {
+    if (const Position *pos = entity.get<Position>())
+      bb.template get<Slot>() = *pos;
+  }
+
+  template<typename Bb>
+  static BehResult update(flecs::world &ecs, flecs::entity entity, Bb &bb)
+  {
+    return patrol_action(ecs, entity, bb.template get<Slot>(), float(PatrolDist));
+  }
+};
+
+// same behaviour as create_minotaur_beh
+using MinotaurBt =
+  Tree<Selector<Sequence<IsLowHp<50>, FindEnemy<4, FleeEnemySlot>, Flee<FleeEnemySlot>>,
+                Sequence<FindEnemy<3, AttackEnemySlot>, MoveToEntity<AttackEnemySlot>>,
+                Patrol<2, PatrolPosSlot>>,
+       FleeEnemySlot, AttackEnemySlot, PatrolPosSlot>;
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <flecs.h>
+#include "behaviourTree.h"
+
+// Behaviour trees composed from types, the counterpart of the runtime built BehNode trees:
+//
+//   using Bt = static_bt::Tree<Selector<Sequence<IsLowHp<50>, FindEnemy<4, FleeEnemySlot>, Flee<FleeEnemySlot>>,
+//                                       Patrol<2, PatrolPosSlot>>,
+//                              FleeEnemySlot, PatrolPosSlot>;
+//
+// Nodes are stateless types with static update(ecs, entity, bb) and optional static init(entity, bb).
+// Blackboard slots are tag types with a value type, a node names the slot it uses as a template
+// argument, so slot lookups are resolved at compile time and the whole tree inlines into one function.
+// Static trees bypass the AI profiler, their nodes have no identity to report.
+namespace static_bt
+{
+
+template<typename Slot, typename First, typename... Rest>
+constexpr size_t slot_index()
+{
+  if constexpr (std::is_same_v<Slot, First>)
+    return 0;
+  else
+  {
+    static_assert(sizeof...(Rest) > 0, "slot isn't declared in the tree");
+    return 1 + slot_index<Slot, Rest...>();
+  }
+}
+
+template<typename... Slots>
+class Blackboard
+{
+  std::tuple<typename Slots::type...> values;
+public:
+  template<typename Slot>
+  typename Slot::type &get() { return std::get<slot_index<Slot, Slots...>()>(values); }
+  template<typename Slot>
+  const typename Slot::type &get() const { return std::get<slot_index<Slot, Slots...>()>(values); }
+};
+
+template<typename Node, typename Bb>
+inline void init_node(flecs::entity entity, Bb &bb)
+{
+  if constexpr (requires { Node::init(entity, bb); })
+    Node::init(entity, bb);
+}
+
+template<typename... Children>
+struct Sequence
+{
+  template<typename Bb>
+  static void init(flecs::entity entity, Bb &bb) { (init_node<Children>(entity, bb), ...); }
+
+  template<typename Bb>
+  static BehResult update(flecs::world &ecs, flecs::entity entity, Bb &bb)
+  {
+    BehResult res = BEH_SUCCESS;
+    (((res = Children::update(ecs, entity, bb)) == BEH_SUCCESS) && ...);
+    return res;
+  }
+};
+
+template<typename... Children>
+struct Selector
+{
+  template<typename Bb>
+  static void init(flecs::entity entity, Bb &bb) { (init_node<Children>(entity, bb), ...); }
+
+  template<typename Bb>
+  static BehResult update(flecs::world &ecs, flecs::entity entity, Bb &bb)
+  {
+    BehResult res = BEH_FAIL;
+    (((res = Children::update(ecs, entity, bb)) == BEH_FAIL) && ...);
+    return res;
+  }
+};
+
+// a component, holds the blackboard values of the tree
+template<typename Root, typename... Slots>
+class Tree
+{
+  Blackboard<Slots...> bb;
+public:
+  using BlackboardType = Blackboard<Slots...>;
+
+  void init(flecs::entity entity) { init_node<Root>(entity, bb); }
+  BehResult update(flecs::world &ecs, flecs::entity entity) { return Root::update(ecs, entity, bb); }
+
+  BlackboardType &blackboard() { return bb; }
+  const BlackboardType &blackboard() const { return bb; }
+};
+
+}
@@ -0,0 +1,41 @@
+#include "targetGrid.h"
+#include "queryCache.h"
+#include "memoryReport.h"
+
+size_t TargetCells::heapBytes() const
+{
+  size_t bytes = heap_bytes(cells);
+  for (const auto &[key, entries] : cells)
+    bytes += heap_bytes(entries);
+  return bytes;
+}
+
+void register_target_grid(flecs::world &ecs)
+{
+  ecs.set(TargetGrid{});
+}
+
+size_t target_grid_memory_bytes(flecs::world &ecs)
+{
+  const TargetGrid *grid = ecs.get<TargetGrid>();
+  if (!grid)
+    return 0;
+  return sizeof(TargetGrid) + grid->actors.heapBytes() + grid->heals.heapBytes() + grid->powerups.heapBytes();
+}
+
+void update_target_grid(flecs::world &ecs)
+{
+  auto &actorsQuery = cached_query<const Position, const Team, const Hitpoints>(ecs);
+  auto &healsQuery = cached_query<const Position, const HealAmount>(ecs);
+  auto &powerupsQuery = cached_query<const Position, const PowerupAmount>(ecs);
+  TargetGrid &grid = *ecs.get_mut<TargetGrid>();
+  grid.actors.clear();
+  actorsQuery.each([&](const Position &pos, const Team &team, const Hitpoints &hp)
+  {
+    grid.actors.add(pos, team.team, hp.hitpoints);
+  });
+  grid.heals.clear();
+  healsQuery.each([&](const Position &pos, const HealAmount &) { grid.heals.add(pos); });
+  grid.powerups.clear();
+  powerupsQuery.each([&](const Position &pos, const PowerupAmount &) { grid.powerups.add(pos); });
+}
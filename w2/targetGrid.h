@@ -0,0 +1,111 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <flecs.h>
+#include "ecsTypes.h"
+#include "math.h"
+
+// Actors and pickups bucketed into square cells, rebuilt once a planning tick. Utility and GOAP agents
+// look at the cells within their sense radius instead of scanning every target in the world.
+
+struct GridEntry
+{
+  Position pos;
+  uint32_t order;  // in query order, distance ties go to the earlier entry like a plain scan would
+  team_t team;     // actors only
+  float hitpoints; // actors only
+};
+
+class TargetCells
+{
+  static constexpr int cell_shift = 3;
+
+  std::unordered_map<uint64_t, std::vector<GridEntry>> cells;
+  uint32_t count = 0;
+
+  static uint64_t cell_key(int cx, int cy)
+  {
+    return uint64_t(uint32_t(cx)) | (uint64_t(uint32_t(cy)) << 32);
+  }
+
+public:
+  void clear()
+  {
+    cells.clear();
+    count = 0;
+  }
+
+  void add(const Position &pos, team_t team = 0, float hitpoints = 0.f)
+  {
+    cells[cell_key(pos.x >> cell_shift, pos.y >> cell_shift)].push_back(GridEntry{pos, count++, team, hitpoints});
+  }
+
+  // calls c for every entry in the cells overlapping the square of radius around pos
+  template<typename Callable>
+  void forEachNear(const Position &pos, float radius, Callable c) const
+  {
+    const int ext = int(ceilf(radius));
+    for (int cy = (pos.y - ext) >> cell_shift; cy <= (pos.y + ext) >> cell_shift; ++cy)
+      for (int cx = (pos.x - ext) >> cell_shift; cx <= (pos.x + ext) >> cell_shift; ++cx)
+      {
+        auto itf = cells.find(cell_key(cx, cy));
+        if (itf == cells.end())
+          continue;
+        for (const GridEntry &entry : itf->second)
+          c(entry);
+      }
+  }
+
+  size_t heapBytes() const;
+};
+
+struct TargetGrid
+{
+  TargetCells actors;
+  TargetCells heals;
+  TargetCells powerups;
+};
+
+// closest entry within radius accepted by filter(entry, dist_sq), nullptr if there's none
+template<typename Filter>
+inline const GridEntry *find_closest_entry(const TargetCells &cells, const Position &pos, float radius,
+                                           float &closest_dist_sq, Filter filter)
+{
+  closest_dist_sq = radius * radius;
+  const GridEntry *res = nullptr;
+  cells.forEachNear(pos, radius, [&](const GridEntry &entry)
+  {
+    const float d = dist_sq(entry.pos, pos);
+    if (d > closest_dist_sq || !filter(entry, d))
+      return;
+    if (d < closest_dist_sq || (res && entry.order < res->order))
+    {
+      closest_dist_sq = d;
+      res = &entry;
+    }
+  });
+  return res;
+}
+
+// closest actor of another team within radius
+inline const GridEntry *find_closest_enemy(const TargetCells &actors, const Position &pos, team_t team, float radius,
+                                           float &closest_dist_sq)
+{
+  return find_closest_entry(actors, pos, radius, closest_dist_sq,
+                            [&](const GridEntry &entry, float) { return entry.team != team; });
+}
+
+// closest pickup within radius, ignoring the own cell
+inline const GridEntry *find_closest_pickup(const TargetCells &pickups, const Position &pos, float radius,
+                                            float &closest_dist_sq)
+{
+  return find_closest_entry(pickups, pos, radius, closest_dist_sq, [](const GridEntry &, float d) { return d > 0.f; });
+}
+
+// Sets up the grid singleton, called on world init
+void register_target_grid(flecs::world &ecs);
+size_t target_grid_memory_bytes(flecs::world &ecs);
+// Called once a planning tick before the agents using it update
+void update_target_grid(flecs::world &ecs);
@@ -0,0 +1,269 @@
+#include "utilityAi.h"
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+#include <vector>
+#include "ecsTypes.h"
+#include "aiUtils.h"
+#include "rng.h"
+#include "influenceMap.h"
+#include "targetGrid.h"
+#include "queryCache.h"
+#include "memoryReport.h"
+
+enum UtilityInput : uint8_t
+{
+  UI_HEALTH = 0,    // hitpoints / profile hp scale
+  UI_ENEMY_DIST,    // nearest enemy distance / sense radius, 1 if none in range
+  UI_ADVANTAGE,     // own damage / (own damage + nearest enemy hitpoints)
+  UI_HEAL_DIST,     // nearest heal distance / sense radius, 1 if none in range
+  UI_NUM
+};
+
+enum UtilityAction : uint8_t
+{
+  UA_ATTACK = 0,
+  UA_FLEE,
+  UA_PATROL,
+  UA_HEAL,
+  UA_NUM
+};
+
+enum CurveType : uint8_t
+{
+  CT_LINEAR = 0,    // m * (x - c) + b
+  CT_POLYNOMIAL,    // m * (x - c)^k + b
+  CT_LOGISTIC       // k / (1 + e^(-m * (x - c))) + b
+};
+
+// outputs are clamped to [0, 1]
+struct ResponseCurve
+{
+  CurveType type = CT_LINEAR;
+  float m = 1.f;
+  float k = 1.f;
+  float b = 0.f;
+  float c = 0.f;
+};
+
+struct Consideration
+{
+  UtilityInput input;
+  ResponseCurve curve;
+};
+
+struct UtilityActionDesc
+{
+  float weight;
+  std::vector<Consideration> considerations;
+};
+
+struct UtilityProfile
+{
+  float hpScale;
+  float senseRadius;
+  float patrolDist;
+  UtilityActionDesc actions[UA_NUM];
+};
+
+static const UtilityProfile profiles[UP_NUM] =
+{
+  {
+    100.f, 5.f, 2.f,
+    {
+      // attack: healthy, enemy close, enemy is weak compared to our hits
+      {1.f, {{UI_HEALTH, {CT_LOGISTIC, 10.f, 1.f, 0.f, 0.4f}},
+             {UI_ENEMY_DIST, {CT_LINEAR, -1.f, 1.f, 1.f, 0.f}},
+             {UI_ADVANTAGE, {CT_LINEAR, 0.7f, 1.f, 0.3f, 0.f}}}},
+      // flee: hurt and enemy close
+      {1.f, {{UI_HEALTH, {CT_POLYNOMIAL, 1.f, 2.f, 0.f, 1.f}},
+             {UI_ENEMY_DIST, {CT_LINEAR, -1.f, 1.f, 1.f, 0.f}}}},
+      // patrol: small constant fallback
+      {0.2f, {}},
+      // heal: hurt and heal is nearby
+      {1.2f, {{UI_HEALTH, {CT_POLYNOMIAL, -1.f, 2.f, 1.f, 0.f}},
+              {UI_HEAL_DIST, {CT_LINEAR, -1.f, 1.f, 1.f, 0.f}}}},
+    }
+  },
+};
+
+// scratch buffers for one profile, kept in a world singleton so allocations survive between turns
+struct UtilityBatch
+{
+  std::vector<flecs::entity> entities;
+  std::vector<Action*> actions;
+  std::vector<Position> positions;
+  std::vector<int> teams;
+  std::vector<Position> patrolPos;
+  std::vector<Position> enemyPos;
+  std::vector<Position> healPos;
+  std::vector<float> inputs[UI_NUM];
+  std::vector<float> scores[UA_NUM];
+
+  void clear()
+  {
+    entities.clear();
+    actions.clear();
+    positions.clear();
+    teams.clear();
+    patrolPos.clear();
+    enemyPos.clear();
+    healPos.clear();
+    for (std::vector<float> &in : inputs)
+      in.clear();
+  }
+};
+
+struct UtilityScratch
+{
+  UtilityBatch batches[UP_NUM];
+};
+
+template<typename F>
+static void apply_curve(const ResponseCurve &curve, const float *in, float *out, size_t count, F f)
+{
+  for (size_t i = 0; i < count; ++i)
+    out[i] *= std::clamp(f(in[i] - curve.c) + curve.b, 0.f, 1.f);
+}
+
+// multiplies scores by the curve over the whole column, the curve type is resolved once per column
+static void score_column(const ResponseCurve &curve, const float *in, float *out, size_t count)
+{
+  const float m = curve.m;
+  const float k = curve.k;
+  if (curve.type == CT_LINEAR)
+    apply_curve(curve, in, out, count, [m](float x) { return m * x; });
+  else if (curve.type == CT_POLYNOMIAL)
+    apply_curve(curve, in, out, count, [m, k](float x) { return m * powf(x, k); });
+  else
+    apply_curve(curve, in, out, count, [m, k](float x) { return k / (1.f + expf(-m * x)); });
+}
+
+// returns normalized distance to the closest target within radius or 1 if there's none
+static float nearest(const TargetCells &targets, const Position &pos, float radius, Position &res)
+{
+  float closestDistSq = 0.f;
+  const GridEntry *target = find_closest_pickup(targets, pos, radius, closestDistSq);
+  if (!target)
+    return 1.f;
+  res = target->pos;
+  return sqrtf(closestDistSq) / radius;
+}
+
+static void gather(flecs::world &ecs, UtilityScratch &scratch)
+{
+  auto &agentsQuery = cached_query<struct AwakeUtilityAgentsQuery>(ecs, [&]
+  {
+    return ecs.query_builder<const UtilityAgent, const Position, const PatrolPos, const Hitpoints, const MeleeDamage,
+                             const Team, Action>()
+      .term<Dormant>().not_()
+      .build();
+  });
+
+  const TargetGrid &grid = *ecs.get<TargetGrid>();
+
+  for (UtilityBatch &batch : scratch.batches)
+    batch.clear();
+  agentsQuery.each([&](flecs::entity e, const UtilityAgent &agent, const Position &pos, const PatrolPos &ppos,
+                       const Hitpoints &hp, const MeleeDamage &dmg, const Team &team, Action &a)
+  {
+    if (agent.profile >= UP_NUM)
+      return;
+    const UtilityProfile &profile = profiles[agent.profile];
+    UtilityBatch &batch = scratch.batches[agent.profile];
+
+    float enemyDistSq = 0.f;
+    const GridEntry *enemy = find_closest_enemy(grid.actors, pos, team.team, profile.senseRadius, enemyDistSq);
+    Position healPos = pos;
+
+    batch.entities.push_back(e);
+    batch.actions.push_back(&a);
+    batch.positions.push_back(pos);
+    batch.teams.push_back(team.team);
+    batch.patrolPos.push_back(Position{ppos.x, ppos.y});
+    batch.enemyPos.push_back(enemy ? enemy->pos : pos);
+    batch.inputs[UI_HEALTH].push_back(std::clamp(hp.hitpoints / profile.hpScale, 0.f, 1.f));
+    batch.inputs[UI_ENEMY_DIST].push_back(enemy ? sqrtf(enemyDistSq) / profile.senseRadius : 1.f);
+    batch.inputs[UI_ADVANTAGE].push_back(enemy ? dmg.damage / (dmg.damage + std::max(enemy->hitpoints, 0.f)) : 0.f);
+    batch.inputs[UI_HEAL_DIST].push_back(nearest(grid.heals, pos, profile.senseRadius, healPos));
+    batch.healPos.push_back(healPos);
+  });
+}
+
+static void score(const UtilityProfile &profile, UtilityBatch &batch)
+{
+  const size_t count = batch.entities.size();
+  for (int act = 0; act < UA_NUM; ++act)
+  {
+    const UtilityActionDesc &desc = profile.actions[act];
+    std::vector<float> &scores = batch.scores[act];
+    scores.assign(count, desc.weight);
+    for (const Consideration &cons : desc.considerations)
+      score_column(cons.curve, batch.inputs[cons.input].data(), scores.data(), count);
+  }
+}
+
+static void act(flecs::world &ecs, const UtilityProfile &profile, const UtilityBatch &batch)
+{
+  for (size_t i = 0; i < batch.entities.size(); ++i)
+  {
+    int best = UA_PATROL;
+    float bestScore = -FLT_MAX;
+    for (int act = 0; act < UA_NUM; ++act)
+      if (batch.scores[act][i] > bestScore)
+      {
+        bestScore = batch.scores[act][i];
+        best = act;
+      }
+
+    const Position &pos = batch.positions[i];
+    auto &action = batch.actions[i]->action;
+    if (best == UA_ATTACK)
+      action = move_towards(pos, batch.enemyPos[i]);
+    else if (best == UA_FLEE)
+      action = least_threat_move(ecs, batch.teams[i], pos, inverse_move(move_towards(pos, batch.enemyPos[i])));
+    else if (best == UA_HEAL)
+      action = move_towards(pos, batch.healPos[i]);
+    else if (dist(pos, batch.patrolPos[i]) > profile.patrolDist)
+      action = move_towards(pos, batch.patrolPos[i]);
+    else
+      action = avoid_threat_move(ecs, batch.teams[i], pos, entity_rng(ecs, batch.entities[i]).range(EA_MOVE_START, EA_MOVE_END - 1));
+  }
+}
+
+size_t utility_scratch_memory_bytes(flecs::world &ecs)
+{
+  const UtilityScratch *scratch = ecs.get<UtilityScratch>();
+  if (!scratch)
+    return 0;
+  size_t bytes = sizeof(UtilityScratch);
+  for (const UtilityBatch &batch : scratch->batches)
+  {
+    bytes += heap_bytes(batch.entities) + heap_bytes(batch.actions) + heap_bytes(batch.positions) +
+             heap_bytes(batch.teams) + heap_bytes(batch.patrolPos) + heap_bytes(batch.enemyPos) + heap_bytes(batch.healPos);
+    for (const std::vector<float> &in : batch.inputs)
+      bytes += heap_bytes(in);
+    for (const std::vector<float> &scores : batch.scores)
+      bytes += heap_bytes(scores);
+  }
+  return bytes;
+}
+
+void register_utility_agents(flecs::world &ecs)
+{
+  ecs.set(UtilityScratch{});
+}
+
+void update_utility_agents(flecs::world &ecs)
+{
+  UtilityScratch &scratch = *ecs.get_mut<UtilityScratch>();
+  gather(ecs, scratch);
+  for (int i = 0; i < UP_NUM; ++i)
+  {
+    UtilityBatch &batch = scratch.batches[i];
+    if (batch.entities.empty())
+      continue;
+    score(profiles[i], batch);
+    act(ecs, profiles[i], batch);
+  }
+}
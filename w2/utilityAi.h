@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <flecs.h>
+
+// Utility AI: every candidate action is scored as a product of response curves over agent inputs,
+// the best scoring action wins. Agents of the same profile are scored together, one curve at a
+// time over SoA input columns, so the inner loops are plain float loops with no virtual calls.
+
+enum UtilityProfileType : uint8_t
+{
+  UP_BRAWLER = 0,
+  UP_NUM
+};
+
+struct UtilityAgent
+{
+  uint8_t profile = UP_BRAWLER;
+};
+
+// Sets up the scratch singleton, called on world init
+void register_utility_agents(flecs::world &ecs);
+size_t utility_scratch_memory_bytes(flecs::world &ecs);
+// Scores all UtilityAgent entities and writes the chosen Action
+void update_utility_agents(flecs::world &ecs);
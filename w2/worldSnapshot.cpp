@@ -0,0 +1,518 @@
+#include "worldSnapshot.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "raylib.h"
+#include "ecsTypes.h"
+#include "stateMachine.h"
+#include "blackboard.h"
+#include "aiArchetypes.h"
+#include "bulkSpawn.h"
+#include "mappedFile.h"
+#include "queryCache.h"
+
+template<typename... Ts>
+struct ComponentList
+{
+  static constexpr uint32_t size = uint32_t(sizeof...(Ts));
+
+  template<typename Callable>
+  static void forEach(Callable &&c)
+  {
+    uint32_t idx = 0;
+    (c.template operator()<Ts>(idx++), ...);
+  }
+
+  template<typename T>
+  static constexpr uint32_t indexOf()
+  {
+    uint32_t idx = 0;
+    uint32_t res = size;
+    ((res = std::is_same_v<T, Ts> ? idx : res, ++idx), ...);
+    return res;
+  }
+};
+
+// Plain data components stored as raw columns, order defines bits of the group mask
+using PodComponents = ComponentList<Position, MovePos, PatrolPos, Hitpoints, Action, NumActions, MeleeDamage,
+                                    HealAmount, PowerupAmount, PlayerInput, Team, Color, AiArchetype>;
+
+enum SnapshotFlags : uint32_t
+{
+  SF_IS_PLAYER = 1u << PodComponents::size,
+  SF_TEXTURE_SOURCE = SF_IS_PLAYER << 1,
+  SF_STATE_MACHINE = SF_IS_PLAYER << 2,
+  SF_BLACKBOARD = SF_IS_PLAYER << 3,
+  SF_CAN_PICKUP = SF_IS_PLAYER << 4
+};
+
+static constexpr char snapshot_magic[4] = {'R', 'G', 'S', 'N'};
+static constexpr uint32_t snapshot_version = 2;
+static constexpr uint32_t no_texture = ~0u;
+static constexpr size_t snapshot_align = 8;
+static constexpr size_t max_pod_components = 27;
+static_assert(PodComponents::size <= max_pod_components, "not enough bits left for snapshot flags");
+
+struct SnapshotHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t seed;
+  uint64_t turn;
+  uint32_t numStrings;
+  uint32_t numGroups;
+  uint8_t componentSizes[max_pod_components];
+  uint32_t reserved;
+};
+
+struct GroupHeader
+{
+  uint32_t mask;
+  uint32_t texture;
+  uint32_t count;
+  uint32_t aiBytes;
+};
+
+static void get_component_sizes(uint8_t (&sizes)[max_pod_components])
+{
+  memset(sizes, 0, sizeof(sizes));
+  PodComponents::forEach([&]<typename T>(uint32_t idx)
+  {
+    static_assert(std::is_trivially_copyable_v<T>, "snapshot columns must be plain data");
+    sizes[idx] = uint8_t(sizeof(T));
+  });
+}
+
+// --- saving ---
+
+struct SnapshotGroup
+{
+  GroupHeader header = {};
+  std::vector<uint8_t> columns[PodComponents::size];
+  std::vector<uint64_t> ids;
+  std::vector<uint8_t> ai;
+};
+
+template<typename T>
+static void append(std::vector<uint8_t> &buf, const T &val)
+{
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&val);
+  buf.insert(buf.end(), bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+static void save_bb_pool(std::vector<uint8_t> &buf, const Blackboard &bb)
+{
+  append(buf, uint32_t(bb.size<T>()));
+  for (size_t i = 0; i < bb.size<T>(); ++i)
+  {
+    if constexpr (std::is_same_v<T, flecs::entity>)
+      append(buf, uint64_t(bb.get<T>(i).id()));
+    else
+      append(buf, bb.get<T>(i));
+  }
+}
+
+// writes either to a file or appends to a memory buffer
+class SnapshotWriter
+{
+  FILE *file = nullptr;
+  std::vector<uint8_t> *buffer = nullptr;
+  size_t offset = 0;
+public:
+  explicit SnapshotWriter(FILE *f) : file(f) {}
+  explicit SnapshotWriter(std::vector<uint8_t> &buf) : buffer(&buf), offset(buf.size()) {}
+
+  bool write(const void *data, size_t size)
+  {
+    offset += size;
+    if (buffer)
+    {
+      const uint8_t *bytes = static_cast<const uint8_t*>(data);
+      buffer->insert(buffer->end(), bytes, bytes + size);
+      return true;
+    }
+    return size == 0 || fwrite(data, 1, size, file) == size;
+  }
+
+  bool align()
+  {
+    static const uint8_t zeros[snapshot_align] = {};
+    return write(zeros, (snapshot_align - offset % snapshot_align) % snapshot_align);
+  }
+
+  bool writeAligned(const void *data, size_t size)
+  {
+    return write(data, size) && align();
+  }
+};
+
+struct SnapshotContents
+{
+  std::vector<std::string> strings;
+  std::unordered_map<flecs::entity_t, uint32_t> textureIndices;
+  std::unordered_map<uint64_t, SnapshotGroup> groups;
+
+  void add(flecs::entity e);
+};
+
+void SnapshotContents::add(flecs::entity e)
+{
+  uint32_t mask = 0;
+  PodComponents::forEach([&]<typename T>(uint32_t idx)
+  {
+    if (e.has<T>())
+      mask |= 1u << idx;
+  });
+  if (e.has<IsPlayer>())
+    mask |= SF_IS_PLAYER;
+  if (e.has<CanPickup>())
+    mask |= SF_CAN_PICKUP;
+  if (e.has<StateMachine>())
+    mask |= SF_STATE_MACHINE;
+  if (e.has<Blackboard>())
+    mask |= SF_BLACKBOARD;
+
+  uint32_t texture = no_texture;
+  const flecs::entity textureSrc = e.target<TextureSource>();
+  if (textureSrc.id() != 0)
+  {
+    mask |= SF_TEXTURE_SOURCE;
+    auto [itf, inserted] = textureIndices.try_emplace(textureSrc.id(), uint32_t(strings.size()));
+    if (inserted)
+      strings.emplace_back(textureSrc.name().c_str());
+    texture = itf->second;
+  }
+
+  SnapshotGroup &group = groups[uint64_t(mask) | (uint64_t(texture) << 32)];
+  group.header.mask = mask;
+  group.header.texture = texture;
+  group.header.count++;
+  PodComponents::forEach([&]<typename T>(uint32_t idx)
+  {
+    if (mask & (1u << idx))
+      append(group.columns[idx], *e.get<T>());
+  });
+  group.ids.push_back(e.id());
+  if (mask & SF_STATE_MACHINE)
+    append(group.ai, uint32_t(e.get<StateMachine>()->getCurState()));
+  if (mask & SF_BLACKBOARD)
+  {
+    const Blackboard &bb = *e.get<Blackboard>();
+    save_bb_pool<float>(group.ai, bb);
+    save_bb_pool<int>(group.ai, bb);
+    save_bb_pool<flecs::entity>(group.ai, bb);
+    save_bb_pool<Position>(group.ai, bb);
+  }
+}
+
+static bool write_snapshot(flecs::world &ecs, SnapshotContents &contents, SnapshotWriter &writer)
+{
+  const std::vector<std::string> &strings = contents.strings;
+  std::unordered_map<uint64_t, SnapshotGroup> &groups = contents.groups;
+  SnapshotHeader header = {};
+  memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+  header.version = snapshot_version;
+  header.seed = ecs.has<WorldSeed>() ? ecs.get<WorldSeed>()->seed : 0;
+  header.turn = ecs.has<TurnCounter>() ? ecs.get<TurnCounter>()->turn : 0;
+  header.numStrings = uint32_t(strings.size());
+  header.numGroups = uint32_t(groups.size());
+  get_component_sizes(header.componentSizes);
+
+  bool ok = writer.writeAligned(&header, sizeof(header));
+  for (const std::string &str : strings)
+  {
+    const uint32_t len = uint32_t(str.size());
+    ok = ok && writer.writeAligned(&len, sizeof(len)) && writer.writeAligned(str.data(), str.size());
+  }
+  for (auto &[key, group] : groups)
+  {
+    group.header.aiBytes = uint32_t(group.ai.size());
+    ok = ok && writer.writeAligned(&group.header, sizeof(group.header));
+    for (const std::vector<uint8_t> &column : group.columns)
+      if (!column.empty())
+        ok = ok && writer.writeAligned(column.data(), column.size());
+    ok = ok && writer.writeAligned(group.ids.data(), group.ids.size() * sizeof(uint64_t));
+    ok = ok && writer.writeAligned(group.ai.data(), group.ai.size());
+  }
+  return ok;
+}
+
+bool save_world_snapshot(flecs::world &ecs, const char *path)
+{
+  SnapshotContents contents;
+  auto &entitiesQuery = cached_query<const Position>(ecs);
+  entitiesQuery.each([&](flecs::entity e, const Position &) { contents.add(e); });
+
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+  SnapshotWriter writer(file);
+  bool ok = write_snapshot(ecs, contents, writer);
+  ok = fclose(file) == 0 && ok;
+  return ok;
+}
+
+void save_entities_snapshot(flecs::world &ecs, const flecs::entity_t *entities, size_t count, std::vector<uint8_t> &out)
+{
+  SnapshotContents contents;
+  for (size_t i = 0; i < count; ++i)
+    contents.add(ecs.entity(entities[i]));
+  SnapshotWriter writer(out);
+  write_snapshot(ecs, contents, writer);
+}
+
+// --- loading ---
+
+class SnapshotCursor
+{
+  const uint8_t *base = nullptr;
+  const uint8_t *ptr = nullptr;
+  const uint8_t *end = nullptr;
+public:
+  SnapshotCursor(const uint8_t *data, size_t size) : base(data), ptr(data), end(data + size) {}
+
+  // returns nullptr if there's not enough data left, skips padding after the block
+  const uint8_t *take(size_t size)
+  {
+    if (size_t(end - ptr) < size)
+      return nullptr;
+    const uint8_t *res = ptr;
+    ptr += size;
+    const size_t padding = (snapshot_align - size_t(ptr - base) % snapshot_align) % snapshot_align;
+    ptr += std::min(padding, size_t(end - ptr));
+    return res;
+  }
+
+  template<typename T>
+  bool read(T &val)
+  {
+    const uint8_t *data = take(sizeof(T));
+    if (data)
+      memcpy(&val, data, sizeof(T));
+    return data != nullptr;
+  }
+};
+
+class BlobReader
+{
+  const uint8_t *ptr = nullptr;
+  const uint8_t *end = nullptr;
+public:
+  BlobReader(const uint8_t *data, size_t size) : ptr(data), end(data + size) {}
+
+  template<typename T>
+  T read()
+  {
+    T val = {};
+    if (size_t(end - ptr) >= sizeof(T))
+    {
+      memcpy(&val, ptr, sizeof(T));
+      ptr += sizeof(T);
+    }
+    else
+      ptr = end;
+    return val;
+  }
+};
+
+struct LoadedGroup
+{
+  GroupHeader header = {};
+  const uint8_t *columns[PodComponents::size] = {};
+  const uint8_t *ids = nullptr;
+  const uint8_t *ai = nullptr;
+  std::vector<flecs::entity_t> entities;
+};
+
+using EntityRemap = std::unordered_map<uint64_t, flecs::entity_t>;
+
+template<typename T>
+static void load_bb_pool(flecs::world &ecs, BlobReader &blob, Blackboard &bb, const EntityRemap &remap, bool keepExternal)
+{
+  const uint32_t count = blob.read<uint32_t>();
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    T val = {};
+    if constexpr (std::is_same_v<T, flecs::entity>)
+    {
+      const uint64_t oldId = blob.read<uint64_t>();
+      const auto itf = remap.find(oldId);
+      if (itf != remap.end())
+        val = ecs.entity(itf->second);
+      else if (keepExternal && ecs.is_alive(oldId))
+        val = ecs.entity(oldId);
+    }
+    else
+      val = blob.read<T>();
+    // slots are registered by the rebuilt behaviour, anything extra is stale
+    if (i < bb.size<T>())
+      bb.set<T>(i, val);
+  }
+}
+
+struct LoadedSnapshot
+{
+  SnapshotHeader header = {};
+  std::vector<std::string> strings;
+  std::vector<LoadedGroup> groups;
+  size_t totalEntities = 0;
+};
+
+// validates and indexes the whole snapshot before anything touches the world
+static bool parse_snapshot(const uint8_t *data, size_t size, const char *path, LoadedSnapshot &snapshot)
+{
+  SnapshotCursor cursor(data, size);
+  SnapshotHeader &header = snapshot.header;
+  uint8_t expectedSizes[max_pod_components];
+  get_component_sizes(expectedSizes);
+  if (!cursor.read(header) || memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0 ||
+      header.version != snapshot_version || memcmp(header.componentSizes, expectedSizes, sizeof(expectedSizes)) != 0)
+  {
+    fprintf(stderr, "'%s' is not a compatible world snapshot\n", path);
+    return false;
+  }
+
+  std::vector<std::string> &strings = snapshot.strings;
+  strings.resize(header.numStrings);
+  for (std::string &str : strings)
+  {
+    uint32_t len = 0;
+    const uint8_t *chars = cursor.read(len) ? cursor.take(len) : nullptr;
+    if (!chars)
+      return false;
+    str.assign(reinterpret_cast<const char*>(chars), len);
+  }
+  std::vector<LoadedGroup> &groups = snapshot.groups;
+  groups.resize(header.numGroups);
+  for (LoadedGroup &group : groups)
+  {
+    bool ok = cursor.read(group.header);
+    const uint32_t count = group.header.count;
+    PodComponents::forEach([&]<typename T>(uint32_t idx)
+    {
+      if (ok && (group.header.mask & (1u << idx)))
+        ok = (group.columns[idx] = cursor.take(size_t(count) * sizeof(T))) != nullptr;
+    });
+    ok = ok && (group.ids = cursor.take(size_t(count) * sizeof(uint64_t))) != nullptr;
+    ok = ok && (group.ai = cursor.take(group.header.aiBytes)) != nullptr;
+    ok = ok && (!(group.header.mask & SF_TEXTURE_SOURCE) || group.header.texture < strings.size());
+    if (!ok)
+    {
+      fprintf(stderr, "world snapshot '%s' is truncated\n", path);
+      return false;
+    }
+    snapshot.totalEntities += count;
+  }
+  return true;
+}
+
+// keepExternal lets blackboards reference live entities that aren't part of the snapshot
+static void spawn_snapshot(flecs::world &ecs, LoadedSnapshot &snapshot, bool keepExternal)
+{
+  const std::vector<std::string> &strings = snapshot.strings;
+  std::vector<LoadedGroup> &groups = snapshot.groups;
+  // bulk insert columns straight from the source memory
+  EntityRemap remap;
+  remap.reserve(snapshot.totalEntities);
+  for (LoadedGroup &group : groups)
+  {
+    const uint32_t mask = group.header.mask;
+    BulkSpawner spawner(ecs);
+    PodComponents::forEach([&]<typename T>(uint32_t idx)
+    {
+      if (mask & (1u << idx))
+        spawner.add<T>(reinterpret_cast<const T*>(group.columns[idx]));
+    });
+    if (mask & SF_IS_PLAYER)
+      spawner.add<IsPlayer>();
+    if (mask & SF_CAN_PICKUP)
+      spawner.add<CanPickup>();
+    if (mask & SF_TEXTURE_SOURCE)
+    {
+      // an unknown texture (saved by a build having more of them) is dropped, the entity is drawn as a rectangle
+      const flecs::entity texture = ecs.lookup(strings[group.header.texture].c_str());
+      if (texture.is_alive() && texture.has<Texture2D>())
+        spawner.addPair<TextureSource>(texture);
+    }
+    if (mask & SF_STATE_MACHINE)
+      spawner.add<StateMachine>();
+    if (mask & SF_BLACKBOARD)
+      spawner.add<Blackboard>();
+
+    const flecs::entity_t *created = spawner.spawn(int32_t(group.header.count));
+    group.entities.assign(created, created + group.header.count);
+    for (size_t i = 0; i < group.entities.size(); ++i)
+    {
+      uint64_t oldId = 0;
+      memcpy(&oldId, group.ids + i * sizeof(uint64_t), sizeof(oldId));
+      remap.emplace(oldId, group.entities[i]);
+    }
+  }
+
+  // AI graphs are object graphs, they have to be rebuilt per entity
+  constexpr uint32_t archetypeIdx = PodComponents::indexOf<AiArchetype>();
+  constexpr uint32_t archetypeBit = 1u << archetypeIdx;
+  for (LoadedGroup &group : groups)
+  {
+    const uint32_t mask = group.header.mask;
+    if (!(mask & (archetypeBit | SF_STATE_MACHINE | SF_BLACKBOARD)))
+      continue;
+    BlobReader blob(group.ai, group.header.aiBytes);
+    for (size_t i = 0; i < group.entities.size(); ++i)
+    {
+      flecs::entity e = ecs.entity(group.entities[i]);
+      if (mask & archetypeBit)
+      {
+        AiArchetype archetype;
+        memcpy(&archetype, group.columns[archetypeIdx] + i * sizeof(AiArchetype), sizeof(AiArchetype));
+        apply_ai_archetype(e, archetype.type);
+      }
+      if (mask & SF_STATE_MACHINE)
+      {
+        const uint32_t state = blob.read<uint32_t>();
+        e.set([&](StateMachine &sm) { sm.setCurState(state); });
+      }
+      if (mask & SF_BLACKBOARD)
+      {
+        e.set([&](Blackboard &bb)
+        {
+          load_bb_pool<float>(ecs, blob, bb, remap, keepExternal);
+          load_bb_pool<int>(ecs, blob, bb, remap, keepExternal);
+          load_bb_pool<flecs::entity>(ecs, blob, bb, remap, keepExternal);
+          load_bb_pool<Position>(ecs, blob, bb, remap, keepExternal);
+        });
+      }
+    }
+  }
+
+}
+
+bool load_world_snapshot(flecs::world &ecs, const char *path)
+{
+  MappedFile file;
+  if (!file.open(path))
+    return false;
+  LoadedSnapshot snapshot;
+  if (!parse_snapshot(file.data(), file.size(), path, snapshot))
+    return false;
+
+  ecs.delete_with<Position>();
+  ecs.set(WorldSeed{snapshot.header.seed});
+  ecs.set(TurnCounter{snapshot.header.turn});
+  spawn_snapshot(ecs, snapshot, false);
+  return true;
+}
+
+bool load_entities_snapshot(flecs::world &ecs, const uint8_t *data, size_t size, const char *name)
+{
+  LoadedSnapshot snapshot;
+  if (!parse_snapshot(data, size, name, snapshot))
+    return false;
+  spawn_snapshot(ecs, snapshot, true);
+  return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <flecs.h>
+
+// Binary world snapshots. Entities are grouped by archetype and every plain data component is
+// stored as a contiguous, 8 byte aligned column, so loading memory-maps the file and hands the
+// columns straight to flecs bulk creation. Behaviour trees and state machines are rebuilt from
+// AiArchetype, then their state (FSM state index, blackboard contents) is restored.
+// Snapshots are host endian and only valid for the same component layout (it's checked on load).
+
+bool save_world_snapshot(flecs::world &ecs, const char *path);
+// Replaces all entities having Position with the snapshot contents
+bool load_world_snapshot(flecs::world &ecs, const char *path);
+
+// Same layout for a subset of the world kept in memory, used to stream chunks of it in and out.
+// Appends to out, blackboard references to entities outside the subset are kept if they are still alive on load.
+void save_entities_snapshot(flecs::world &ecs, const flecs::entity_t *entities, size_t count, std::vector<uint8_t> &out);
+// Adds the entities to the world, data has to be 8 byte aligned
+bool load_entities_snapshot(flecs::world &ecs, const uint8_t *data, size_t size, const char *name);